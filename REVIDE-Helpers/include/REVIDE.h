@@ -1,18 +1,521 @@
-// Copy this header (together with httplib.h) to your project
+// Copy this header (together with httplib.h and ModulePrinter.h) to your project
 // Then you can do REVIDE::Dump(Module) to dump an LLVM module
 
 #pragma once
 
 #include "httplib.h"
+#include "ModulePrinter.h"
 
+#include <llvm/Analysis/LazyCallGraph.h>
+#include <llvm/Analysis/LoopInfo.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
 #include <llvm/IR/Module.h>
+#include <llvm/IR/PassInstrumentation.h>
 #include <llvm/IRReader/IRReader.h>
+#include <llvm/Support/Regex.h>
 #include <llvm/Support/SourceMgr.h>
 #include <llvm/Support/raw_ostream.h>
 #include <llvm/Transforms/Utils/Cloning.h>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif // _WIN32
+
 namespace REVIDE
 {
+// Set these before the first call to Dump
+struct Options
+{
+    std::string host = "localhost";
+    int port = 13337;
+    // Bitcode is several times smaller than the textual IR and faster to write and to read
+    enum class Format
+    {
+        Text,
+        Bitcode,
+    } format = Format::Text;
+    // gzip the body on the wire, requires CPPHTTPLIB_ZLIB_SUPPORT
+    bool compress = true;
+    // Only send the functions (and the text between them) that changed since the previous dump
+    // with the same title, REVIDE reconstructs the module from its last copy. Text format only
+    bool delta = false;
+    // Dump only prints the module and queues it, a background thread sends the queued modules.
+    // Use this to instrument hot passes without measuring the network
+    bool async = false;
+    // Number of printed modules waiting to be sent in async mode, 0 means no limit
+    size_t maxQueued = 16;
+    // What Dump does when the queue is full: wait for the sender or throw away the oldest module
+    enum class QueueFull
+    {
+        Block,
+        DropOldest,
+    } queueFull = QueueFull::Block;
+    // REVIDE runs on this machine: large bodies are written to a shared memory object and only
+    // its name is sent, REVIDE parses the module straight from the mapping. When REVIDE cannot
+    // open the object (another machine or container) the bodies are sent normally again
+    bool sharedMemory = false;
+};
+
+inline Options& GetOptions()
+{
+    static Options options;
+    return options;
+}
+
+namespace detail
+{
+struct Request
+{
+    std::string path;
+    std::string body;
+    std::string fallback; // sent instead of the body when REVIDE does not have the delta base
+    std::string deltaTitle; // of a delta, the next one is a full module when this one is lost
+};
+
+// Splits printed IR into the functions and the text between them, the pieces add up to the text
+inline std::vector<llvm::StringRef> SplitFunctions(llvm::StringRef text)
+{
+    std::vector<llvm::StringRef> segments;
+    size_t begin = 0;
+    auto addSegment = [&](size_t end) {
+        if (end > begin)
+            segments.push_back(text.substr(begin, end - begin));
+        begin = end;
+    };
+    auto lineEnd = [&](size_t pos) {
+        auto end = text.find('\n', pos);
+        return end == llvm::StringRef::npos ? text.size() : end + 1;
+    };
+    auto startsWith = [&](size_t pos, llvm::StringRef prefix) {
+        return text.substr(pos).startswith(prefix);
+    };
+
+    auto previousLine = llvm::StringRef::npos;
+    for (size_t pos = 0; pos < text.size();)
+    {
+        auto end = lineEnd(pos);
+        auto isDefine = startsWith(pos, "define ");
+        if (isDefine || startsWith(pos, "declare "))
+        {
+            // The attributes comment belongs to the function
+            auto start = pos;
+            if (previousLine != llvm::StringRef::npos && startsWith(previousLine, "; Function Attrs:"))
+                start = previousLine;
+            addSegment(start);
+            if (isDefine)
+            {
+                while (end < text.size() && !startsWith(end, "}"))
+                    end = lineEnd(end);
+                end = lineEnd(end);
+            }
+            addSegment(end);
+            previousLine = llvm::StringRef::npos;
+        }
+        else
+        {
+            previousLine = pos;
+        }
+        pos = end;
+    }
+    addSegment(text.size());
+    return segments;
+}
+
+inline uint64_t ProcessId()
+{
+#ifdef _WIN32
+    return uint64_t(GetCurrentProcessId());
+#else
+    return uint64_t(getpid());
+#endif // _WIN32
+}
+
+// Quoted and escaped for the metadata of a batch
+inline std::string JsonString(llvm::StringRef str)
+{
+    std::string json = "\"";
+    for (auto ch : str)
+    {
+        if (ch == '"' || ch == '\\')
+        {
+            json += '\\';
+            json += ch;
+        }
+        else if (uint8_t(ch) < 0x20)
+        {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", unsigned(ch));
+            json += escaped;
+        }
+        else
+        {
+            json += ch;
+        }
+    }
+    json += '"';
+    return json;
+}
+
+// Request body in a named shared memory object (POSIX shm_open, a file mapping on Windows).
+// REVIDE maps it while it handles the request, the object is removed when this goes away
+class SharedMemory
+{
+public:
+    SharedMemory() = default;
+
+    SharedMemory(const SharedMemory&) = delete;
+    SharedMemory& operator=(const SharedMemory&) = delete;
+
+    ~SharedMemory()
+    {
+        Release();
+    }
+
+    bool Create(const std::string& data)
+    {
+        Release();
+        static std::atomic<uint64_t> counter{ 0 };
+        mName = "REVIDE-" + std::to_string(ProcessId()) + "-" + std::to_string(++counter);
+
+        // Zero filled, the byte after the body terminates it for the textual IR parser
+        auto size = uint64_t(data.size()) + 1;
+#ifdef _WIN32
+        mHandle = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, DWORD(size >> 32), DWORD(size), ("Local\\" + mName).c_str());
+        if (mHandle == nullptr)
+        {
+            mName.clear();
+            return false;
+        }
+        auto view = MapViewOfFile(mHandle, FILE_MAP_WRITE, 0, 0, data.size());
+        if (view == nullptr)
+        {
+            Release();
+            return false;
+        }
+        memcpy(view, data.data(), data.size());
+        UnmapViewOfFile(view);
+#else
+        // Only readable by the same user
+        auto fd = shm_open(("/" + mName).c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        if (fd == -1)
+        {
+            mName.clear();
+            return false;
+        }
+        void* view = MAP_FAILED;
+        if (ftruncate(fd, off_t(size)) == 0)
+            view = mmap(nullptr, data.size(), PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (view == MAP_FAILED)
+        {
+            Release();
+            return false;
+        }
+        memcpy(view, data.data(), data.size());
+        munmap(view, data.size());
+#endif // _WIN32
+        return true;
+    }
+
+    void Release()
+    {
+        if (mName.empty())
+            return;
+#ifdef _WIN32
+        CloseHandle(mHandle);
+        mHandle = nullptr;
+#else
+        shm_unlink(("/" + mName).c_str());
+#endif // _WIN32
+        mName.clear();
+    }
+
+    const std::string& Name() const
+    {
+        return mName;
+    }
+
+private:
+    std::string mName;
+#ifdef _WIN32
+    HANDLE mHandle = nullptr;
+#endif // _WIN32
+};
+
+// Keeps a single keep-alive connection to REVIDE, the queue is flushed when the process exits
+class Sender
+{
+public:
+    static Sender& Instance()
+    {
+        static Sender sender;
+        return sender;
+    }
+
+    Sender(const Sender&) = delete;
+    Sender& operator=(const Sender&) = delete;
+
+    ~Sender()
+    {
+        Flush();
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mStop = true;
+        }
+        mQueueChanged.notify_all();
+        if (mThread.joinable())
+            mThread.join();
+    }
+
+    // Remembers the segments of the text, the next delta of the title refers to them
+    Request MakeDelta(const std::string& path, const std::string& title, const std::string& text)
+    {
+        std::lock_guard<std::mutex> lock(mDeltaMutex);
+        auto& state = mDeltaStates[title];
+        // The ids keep increasing after a reset, REVIDE cannot confuse an old base with a new one
+        auto base = state.hashes.empty() ? 0 : state.id;
+        state.id++;
+        auto header = "REVIDE-DELTA " + std::to_string(state.id) + " ";
+
+        Request request;
+        // The bases are kept per producer, other processes can dump modules with the same title
+        request.path = path + "&producer=" + mProducer;
+        request.deltaTitle = title;
+        request.body = header + std::to_string(base) + "\n";
+        request.fallback = header + "0\n";
+        request.fallback.reserve(text.size() + request.fallback.size());
+        // Consecutive references are merged into a single run, identical segments (e.g. the
+        // empty lines between functions) continue the run if possible
+        DeltaState next;
+        next.id = state.id;
+        size_t runBegin = 0, runLength = 0;
+        auto flushRun = [&]() {
+            if (runLength > 0)
+                request.body += "R " + std::to_string(runBegin) + " " + std::to_string(runLength) + "\n";
+            runLength = 0;
+        };
+        for (auto segment : SplitFunctions(text))
+        {
+            size_t hash = llvm::hash_value(segment);
+            auto literal = "T " + std::to_string(segment.size()) + "\n";
+            request.fallback += literal;
+            request.fallback.append(segment.data(), segment.size());
+            auto continuesRun = runLength > 0 && runBegin + runLength < state.hashes.size() && state.hashes[runBegin + runLength] == hash;
+            auto itr = state.segments.find(hash);
+            if (continuesRun)
+            {
+                runLength++;
+            }
+            else if (itr != state.segments.end())
+            {
+                flushRun();
+                runBegin = itr->second;
+                runLength = 1;
+            }
+            else
+            {
+                flushRun();
+                request.body += literal;
+                request.body.append(segment.data(), segment.size());
+            }
+            next.segments.emplace(hash, next.hashes.size());
+            next.hashes.push_back(hash);
+        }
+        flushRun();
+        state = std::move(next);
+        return request;
+    }
+
+    void Send(Request request)
+    {
+        const auto& options = GetOptions();
+        if (!options.async)
+        {
+            Post(request);
+            return;
+        }
+
+        std::unique_lock<std::mutex> lock(mMutex);
+        if (!mThread.joinable())
+            mThread = std::thread([this] { Run(); });
+        if (options.maxQueued > 0 && mQueue.size() >= options.maxQueued)
+        {
+            if (options.queueFull == Options::QueueFull::DropOldest)
+            {
+                Lost(mQueue.front());
+                mQueue.pop_front();
+                mDropped++;
+            }
+            else
+            {
+                mQueueChanged.wait(lock, [&] { return mQueue.size() < options.maxQueued; });
+            }
+        }
+        mQueue.push_back(std::move(request));
+        lock.unlock();
+        mQueueChanged.notify_all();
+    }
+
+    // Blocks until every queued module is sent
+    void Flush()
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mQueueChanged.wait(lock, [this] { return mQueue.empty() && !mSending; });
+        if (mDropped > 0)
+        {
+            fprintf(stderr, "REVIDE: dropped %zu modules (queue full)\n", mDropped);
+            mDropped = 0;
+        }
+    }
+
+private:
+    Sender()
+        : mClient(GetOptions().host.c_str(), GetOptions().port)
+    {
+        mClient.set_keep_alive(true);
+#ifdef CPPHTTPLIB_ZLIB_SUPPORT
+        // The body is gzipped on the wire and decompressed by REVIDE while receiving
+        mClient.set_compress(GetOptions().compress);
+#endif // CPPHTTPLIB_ZLIB_SUPPORT
+    }
+
+    void Run()
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        for (;;)
+        {
+            mQueueChanged.wait(lock, [this] { return mStop || !mQueue.empty(); });
+            if (mQueue.empty())
+                return;
+
+            auto request = std::move(mQueue.front());
+            mQueue.pop_front();
+            mSending = true;
+            lock.unlock();
+            mQueueChanged.notify_all();
+            Post(request);
+            lock.lock();
+            mSending = false;
+            mQueueChanged.notify_all();
+        }
+    }
+
+    void Post(const Request& request)
+    {
+        std::lock_guard<std::mutex> lock(mClientMutex);
+        const auto* body = &request.body;
+        SharedMemory shared;
+        const std::string* sharedBody = nullptr;
+        // Reconnecting, the fallbacks below and waiting out a 503 (REVIDE answers it with a
+        // Retry-After hint while too many modules are waiting to be parsed) all count as attempts
+        const int maxAttempts = 30;
+        for (int attempt = 0; attempt < maxAttempts; attempt++)
+        {
+            // Small bodies are cheaper to send than to hand over
+            httplib::Headers headers;
+            if (mSharedMemory && body->size() >= 64 * 1024)
+            {
+                if (sharedBody != body)
+                {
+                    sharedBody = shared.Create(*body) ? body : nullptr;
+                    if (sharedBody == nullptr)
+                        mSharedMemory = false;
+                }
+                if (sharedBody != nullptr)
+                {
+                    headers.emplace("X-REVIDE-Shared-Memory", shared.Name());
+                    headers.emplace("X-REVIDE-Shared-Size", std::to_string(body->size()));
+                }
+            }
+            auto res = headers.empty() ? mClient.Post(request.path.c_str(), *body, "application/octet-stream") : mClient.Post(request.path.c_str(), headers, std::string(), "application/octet-stream");
+            // The kept alive connection might have been closed by the server, reconnect once
+            if (!res && attempt == 0)
+                continue;
+            // REVIDE cannot see the shared memory, send the bodies from now on
+            if (res && res->status == 404 && !headers.empty())
+            {
+                fprintf(stderr, "REVIDE: shared memory is not available, sending the modules instead\n");
+                mSharedMemory = false;
+                continue;
+            }
+            // The previous module of the delta never arrived (dropped, REVIDE restarted)
+            if (res && res->status == 409 && body != &request.fallback && !request.fallback.empty())
+            {
+                body = &request.fallback;
+                continue;
+            }
+            if (!res || res->status != 503)
+            {
+                if (!res || res->status / 100 != 2)
+                    Lost(request);
+                return;
+            }
+            auto retryAfter = httplib::detail::get_header_value_uint64(res->headers, "Retry-After", 1);
+            std::this_thread::sleep_for(std::chrono::seconds(retryAfter));
+        }
+        fprintf(stderr, "REVIDE: gave up sending a module after %d attempts\n", maxAttempts);
+        Lost(request);
+    }
+
+    // REVIDE never received the module, the deltas made from now on must not refer to it
+    void Lost(const Request& request)
+    {
+        if (request.deltaTitle.empty())
+            return;
+        std::lock_guard<std::mutex> lock(mDeltaMutex);
+        auto& state = mDeltaStates[request.deltaTitle];
+        state.hashes.clear();
+        state.segments.clear();
+    }
+
+    std::mutex mClientMutex;
+    httplib::Client mClient;
+    bool mSharedMemory = GetOptions().sharedMemory;
+
+    std::mutex mMutex;
+    std::condition_variable mQueueChanged;
+    std::deque<Request> mQueue;
+    size_t mDropped = 0;
+    bool mSending = false;
+    bool mStop = false;
+    std::thread mThread;
+
+    struct DeltaState
+    {
+        uint64_t id = 0; // of the last dump
+        std::vector<size_t> hashes; // of the segments of the last dump, empty to send a full module
+        std::unordered_map<size_t, size_t> segments; // hash -> first index in hashes
+    };
+    std::mutex mDeltaMutex;
+    std::unordered_map<std::string, DeltaState> mDeltaStates; // by title
+    // Process id and a random number, the process ids are reused
+    std::string mProducer = std::to_string(ProcessId()) + "-" + std::to_string((uint64_t(std::random_device()()) << 32) | std::random_device()());
+};
+} // namespace detail
+
+// Waits until the modules queued in async mode are sent, this also happens when the process exits
+inline void Flush()
+{
+    detail::Sender::Instance().Flush();
+}
+
 inline void Dump(llvm::Module& Module, const std::string& title = std::string())
 {
 
@@ -68,13 +571,26 @@ inline void Dump(llvm::Module& Module, const std::string& title = std::string())
     std::string str;
     std::error_code err;
     llvm::raw_string_ostream rso(str);
-    Module.print(rso, nullptr, false, true);
+    auto& sender = detail::Sender::Instance();
+    detail::Request request;
+    if (GetOptions().format == Options::Format::Bitcode)
+    {
+        llvm::WriteBitcodeToFile(Module, rso);
+        request.path = "/llvm?type=bitcode&title=";
+    }
+    else
+    {
+        str = PrintModule(Module, nullptr, false, true);
+        request.path = GetOptions().delta ? "/llvm?type=delta&title=" : "/llvm?type=module&title=";
+    }
+    rso.flush();
 
-    httplib::Client client("localhost", 13337);
-    std::string path("/llvm?type=module&title=");
-    path += httplib::detail::encode_url(title);
-    str = httplib::detail::base64_encode(str);
-    client.Post(path.c_str(), str, "text/plain");
+    request.path += httplib::detail::encode_url(title);
+    if (GetOptions().delta && GetOptions().format == Options::Format::Text)
+        request = sender.MakeDelta(request.path, title, str);
+    else
+        request.body = std::move(str);
+    sender.Send(std::move(request));
 } // namespace REVIDE
 
 inline void Dump(llvm::Module* Module, const std::string& title = std::string())
@@ -91,4 +607,213 @@ inline void Dump(std::unique_ptr<llvm::Module>& Module, const std::string& title
 {
     return Dump(Module.get(), title);
 }
+
+// Collects modules and sends them in a single request, REVIDE shows the modules of every producer
+// together in the order they were added:
+//
+//   REVIDE::Batch batch;
+//   batch.Add(M, "main", "instcombine");
+//   ...
+//   batch.Send();
+//
+// The sequence numbers continue across Send calls.
+class Batch
+{
+public:
+    // Names the tabs of this process in REVIDE, the process id by default
+    explicit Batch(std::string producer = std::string())
+        : mProducer(producer.empty() ? std::to_string(detail::ProcessId()) : std::move(producer))
+    {
+        Clear();
+    }
+
+    void Add(const llvm::Module& Module, const std::string& title = std::string(), const std::string& pass = std::string())
+    {
+        std::string payload;
+        const char* type = "module";
+        if (GetOptions().format == Options::Format::Bitcode)
+        {
+            llvm::raw_string_ostream rso(payload);
+            llvm::WriteBitcodeToFile(Module, rso);
+            rso.flush();
+            type = "bitcode";
+        }
+        else
+        {
+            payload = PrintModule(Module, nullptr, false, true);
+        }
+
+        auto timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+        mBody += std::to_string(payload.size());
+        mBody += " {\"type\":" + detail::JsonString(type);
+        mBody += ",\"title\":" + detail::JsonString(title);
+        mBody += ",\"producer\":" + detail::JsonString(mProducer);
+        if (!pass.empty())
+            mBody += ",\"pass\":" + detail::JsonString(pass);
+        mBody += ",\"sequence\":" + std::to_string(mSequence++);
+        mBody += ",\"timestamp\":" + std::to_string(timestamp);
+        mBody += "}\n";
+        mBody += payload;
+        mEntries++;
+    }
+
+    // Number of modules waiting to be sent
+    size_t Size() const
+    {
+        return mEntries;
+    }
+
+    void Send()
+    {
+        if (mEntries == 0)
+            return;
+        detail::Request request;
+        request.path = "/llvm/batch";
+        request.body = std::move(mBody);
+        Clear();
+        detail::Sender::Instance().Send(std::move(request));
+    }
+
+private:
+    void Clear()
+    {
+        mBody = "REVIDE-BATCH\n";
+        mEntries = 0;
+    }
+
+    std::string mProducer;
+    std::string mBody;
+    size_t mEntries = 0;
+    uint64_t mSequence = 0;
+};
+
+// Dumps the module after the selected passes of a new pass manager pipeline:
+//
+//   REVIDE::PassDumper::Filter filter;
+//   filter.passes = "instcombine|simplifycfg";
+//   REVIDE::PassDumper dumper(filter);
+//   dumper.registerCallbacks(PIC); // before the PassBuilder is created
+//
+// The dumper has to outlive the pipeline. Combine it with Options::async and Options::delta
+// to keep the overhead low in large pipelines.
+class PassDumper
+{
+public:
+    struct Filter
+    {
+        // Case insensitive, matched against the pass class (InstCombinePass) and the pipeline
+        // name (instcombine) when the PassBuilder registered it
+        std::string passes = ".*";
+        // The function (or one of the functions of a module/SCC pass) has to match
+        std::string functions = ".*";
+        // Only dump every Nth invocation that passed the filters
+        unsigned every = 1;
+        // Passes that preserve all the analyses did not change the IR
+        bool skipUnchanged = true;
+    };
+
+    PassDumper()
+        : PassDumper(Filter())
+    {
+    }
+
+    explicit PassDumper(Filter filter)
+        : mFilter(std::move(filter))
+        , mPasses(mFilter.passes, llvm::Regex::IgnoreCase)
+        , mFunctions(mFilter.functions)
+    {
+        std::string error;
+        if (!mPasses.isValid(error))
+            fprintf(stderr, "REVIDE: invalid pass regex '%s': %s\n", mFilter.passes.c_str(), error.c_str());
+        if (!mFunctions.isValid(error))
+            fprintf(stderr, "REVIDE: invalid function regex '%s': %s\n", mFilter.functions.c_str(), error.c_str());
+    }
+
+    PassDumper(const PassDumper&) = delete;
+    PassDumper& operator=(const PassDumper&) = delete;
+
+    void registerCallbacks(llvm::PassInstrumentationCallbacks& PIC)
+    {
+        PIC.registerAfterPassCallback([this, &PIC](llvm::StringRef PassID, llvm::Any IR, const llvm::PreservedAnalyses& PA) {
+            afterPass(PIC, PassID, IR, PA);
+        });
+    }
+
+    unsigned dumped() const { return mDumped; }
+
+private:
+    void afterPass(llvm::PassInstrumentationCallbacks& PIC, llvm::StringRef PassID, llvm::Any IR, const llvm::PreservedAnalyses& PA)
+    {
+        // The pass managers and adaptors report every pass they contain again, the analysis
+        // utilities do not touch the IR
+        static const std::vector<llvm::StringRef> specials = {
+            "PassManager",
+            "PassAdaptor",
+            "AnalysisManagerProxy",
+            "DevirtSCCRepeatedPass",
+            "ModuleInlinerWrapperPass",
+            "InvalidateAnalysisPass",
+            "RequireAnalysisPass",
+        };
+        if (llvm::isSpecialPass(PassID, specials))
+            return;
+        if (mFilter.skipUnchanged && PA.areAllPreserved())
+            return;
+
+        auto passName = PIC.getPassNameForClassName(PassID);
+        if (!mPasses.match(PassID) && (passName.empty() || !mPasses.match(passName)))
+            return;
+
+        const llvm::Module* module = nullptr;
+        auto functionMatches = [this](const llvm::Function* function) {
+            return !function->isDeclaration() && mFunctions.match(function->getName());
+        };
+        bool matches = false;
+        if (llvm::any_isa<const llvm::Module*>(IR))
+        {
+            module = llvm::any_cast<const llvm::Module*>(IR);
+            for (const auto& function : *module)
+                if ((matches = functionMatches(&function)))
+                    break;
+        }
+        else if (llvm::any_isa<const llvm::Function*>(IR))
+        {
+            auto function = llvm::any_cast<const llvm::Function*>(IR);
+            module = function->getParent();
+            matches = functionMatches(function);
+        }
+        else if (llvm::any_isa<const llvm::LazyCallGraph::SCC*>(IR))
+        {
+            for (const auto& node : *llvm::any_cast<const llvm::LazyCallGraph::SCC*>(IR))
+            {
+                module = node.getFunction().getParent();
+                if ((matches = functionMatches(&node.getFunction())))
+                    break;
+            }
+        }
+        else if (llvm::any_isa<const llvm::Loop*>(IR))
+        {
+            auto function = llvm::any_cast<const llvm::Loop*>(IR)->getHeader()->getParent();
+            module = function->getParent();
+            matches = functionMatches(function);
+        }
+        if (module == nullptr || !matches)
+            return;
+
+        if (mInvocations++ % std::max(mFilter.every, 1u) != 0)
+            return;
+
+        // Invocations of the same pass end up in the same tab (with a snapshot history)
+        auto title = module->getModuleIdentifier() + ": " + (passName.empty() ? PassID : passName).str();
+        // Dump only prints the module
+        Dump(const_cast<llvm::Module&>(*module), title);
+        mDumped++;
+    }
+
+    Filter mFilter;
+    llvm::Regex mPasses;
+    llvm::Regex mFunctions;
+    unsigned mInvocations = 0;
+    unsigned mDumped = 0;
+};
 } // namespace REVIDE
@@ -4,12 +4,16 @@
 #include "DocumentationDialog.h"
 #include "GraphDialog.h"
 #include "QtHelpers.h"
+#include "ModulePrinter.h"
+#include "Metrics.h"
 
 #include <llvm/IR/Module.h>
 #include <llvm/IR/AssemblyAnnotationWriter.h>
 #include <llvm/IR/CFG.h>
+#include <llvm/IR/ModuleSlotTracker.h>
 #include <llvm/IRReader/IRReader.h>
 #include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/Support/MemoryBuffer.h>
 #include <llvm/Support/SourceMgr.h>
 #include <llvm/Support/raw_ostream.h>
 #include <llvm/Support/FormattedStream.h>
@@ -28,6 +32,7 @@
 #include <QDebug>
 #include <QFile>
 #include <QTextCursor>
+#include <QCryptographicHash>
 
 static std::unordered_map<std::string, QString> instructionDocumentation;
 
@@ -88,11 +93,41 @@ struct LLVMGlobalContext
 
     LLVMGlobalContext(const LLVMGlobalContext&) = delete;
 
-    bool Parse(const QByteArray& data, QString& errorMessage, int& errorLine, int& errorColumn)
+    // Bitcode is read directly, otherwise the format is detected from the data. A lazy module
+    // only reads the globals and the function headers, the bodies are materialized on demand
+    bool Parse(const QByteArray& data, bool bitcode, bool lazy, QString& errorMessage, int& errorLine, int& errorColumn)
     {
         // TODO: ModuleID comment goes missing
 
         llvm::StringRef sr(data.constData(), data.size());
+        if (bitcode && lazy)
+        {
+            // The module reads the bodies from the buffer, the data is gone after parsing
+            auto lazyModule = llvm::getOwningLazyBitcodeModule(llvm::MemoryBuffer::getMemBufferCopy(sr), Context);
+            if (!lazyModule)
+            {
+                errorMessage = QString::fromStdString(llvm::toString(lazyModule.takeError()));
+                return false;
+            }
+            errorMessage.clear();
+            SetModule(std::move(*lazyModule));
+            return true;
+        }
+        if (bitcode)
+        {
+            auto bitcodeModule = llvm::parseBitcodeFile(llvm::MemoryBufferRef(sr, ""), Context);
+            if (!bitcodeModule)
+            {
+                errorMessage = QString::fromStdString(llvm::toString(bitcodeModule.takeError()));
+                return false;
+            }
+            errorMessage.clear();
+            SetModule(std::move(*bitcodeModule));
+            return true;
+        }
+
+        // The lexer still reads up to a '\0' after the data, slices of a larger buffer have to be
+        // copied by the caller
         auto buf = llvm::MemoryBuffer::getMemBuffer(sr, "", false);
         llvm::SMDiagnostic Err;
         auto irModule = parseIR(*buf, Err, Context);
@@ -119,19 +154,22 @@ struct LLVMGlobalContext
             return false;
         }
         errorMessage.clear();
-        Module = std::move(irModule);
+        SetModule(std::move(irModule));
+        return true;
+    }
+
+    void SetModule(std::unique_ptr<llvm::Module> module)
+    {
+        Module = std::move(module);
         Functions.clear();
         for (auto& function : Module->functions())
             Functions.push_back(&function);
-        return true;
     }
 
     QVector<AnnotatedLine> Dump()
     {
-        std::string str;
-        llvm::raw_string_ostream rso(str);
         LineAnnotationWriter annotationWriter;
-        Module->print(rso, &annotationWriter, true, true);
+        auto str = REVIDE::PrintModule(*Module, &annotationWriter, true, true);
         QVector<AnnotatedLine> annotatedLines;
         QString line;
         Annotation nextAnnotation;
@@ -194,7 +232,8 @@ struct LLVMGlobalContext
                 else if(nextAnnotation.type == AnnotationType::Function)
                 {
                     auto function = (llvm::Function*)nextAnnotation.ptr;
-                    if(line.startsWith("declare") || line.endsWith('{'))
+                    // Functions that are not materialized are printed as define ... {}
+                    if(line.startsWith("declare") || line.endsWith('{') || line.endsWith("{}"))
                     {
                         nextAnnotation = Annotation();
                     }
@@ -202,25 +241,25 @@ struct LLVMGlobalContext
             }
             line.clear();
         };
-        for (size_t i = 0; i < str.length(); i++)
+        // A QString per line instead of appending the characters one by one
+        for (size_t begin = 0; begin < str.length();)
         {
-            char ch = str[i];
-            if (ch == '\r')
-                continue;
-            if (ch == '\n')
+            auto end = str.find('\n', begin);
+            if (end == std::string::npos)
+                end = str.length();
+            line = QString::fromLatin1(str.data() + begin, int(end - begin));
+            if (line.contains('\r'))
+                line.remove('\r');
+            if (end < str.length() || !line.isEmpty())
                 flushLine();
-            else
-                line += ch;
+            begin = end + 1;
         }
-        if (!line.isEmpty())
-            flushLine();
         return annotatedLines;
     }
 };
 
 BitcodeDialog::BitcodeDialog(QWidget* parent)
     : ads::CDockManager(parent)
-    , mContext(new LLVMGlobalContext())
 {
     auto codeWidget = new QWidget();
     codeWidget->setWindowTitle(tr("Code"));
@@ -246,8 +285,23 @@ BitcodeDialog::BitcodeDialog(QWidget* parent)
     horizontalLayout->addWidget(mButtonGodbolt);
     horizontalLayout->addWidget(mButtonHelp);
 
+    // Timeline of the dumps with the same title, shown once there is more than one.
+    // Only reacts when the slider is released, the snapshot has to be parsed again
+    mLabelSnapshot = new QLabel(codeWidget);
+    mLabelSnapshot->setVisible(false);
+    mSliderSnapshot = new QSlider(Qt::Horizontal, codeWidget);
+    mSliderSnapshot->setTracking(false);
+    mSliderSnapshot->setVisible(false);
+    connect(mSliderSnapshot, &QSlider::sliderMoved, this, &BitcodeDialog::updateSnapshotLabel);
+    connect(mSliderSnapshot, &QSlider::valueChanged, this, &BitcodeDialog::snapshotSlot);
+
+    auto snapshotLayout = new QHBoxLayout();
+    snapshotLayout->addWidget(mLabelSnapshot);
+    snapshotLayout->addWidget(mSliderSnapshot);
+
     auto verticalLayout = new QVBoxLayout();
     verticalLayout->addWidget(mPlainTextBitcode);
+    verticalLayout->addLayout(snapshotLayout);
     verticalLayout->addLayout(horizontalLayout);
     codeWidget->setLayout(verticalLayout);
 
@@ -283,6 +337,10 @@ BitcodeDialog::BitcodeDialog(QWidget* parent)
     //mDocumentationDialog->show();
 
     mGraphDialog = new GraphDialog(this);
+    mGraphDialog->graphView()->setLineHighlighter([this](const QString& line, const QColor& textColor)
+        {
+            return mHighlighter->highlightLine(line, textColor);
+        });
     //mGraphDialog->show();
     connect(mGraphDialog->graphView(), &GenericGraphView::blockSelectionChanged, [this](ut64 blockId)
         {
@@ -321,25 +379,130 @@ BitcodeDialog::BitcodeDialog(QWidget* parent)
 
 BitcodeDialog::~BitcodeDialog()
 {
-    delete mContext;
+    Metrics::instance().removeTab(this);
     delete mHighlighter;
 }
 
-bool BitcodeDialog::load(const QString& type, const QByteArray& data, QString& errorMessage)
+ModuleContent::ModuleContent() = default;
+
+ModuleContent::~ModuleContent() = default;
+
+static std::vector<ModuleContent::Segment> splitSegments(const QVector<AnnotatedLine>& annotatedLines)
+{
+    std::vector<ModuleContent::Segment> segments;
+    auto addSegment = [&](const llvm::Function* function, int begin, int end)
+    {
+        if (begin >= end)
+            return;
+        ModuleContent::Segment segment;
+        segment.function = function;
+        if (function != nullptr)
+        {
+            segment.name = QString::fromStdString(function->getName().str());
+            // Unnamed functions are matched by their position
+            if (segment.name.isEmpty())
+                segment.name = QString("#%1").arg(segments.size());
+        }
+        segment.begin = begin;
+        segment.end = end;
+        QCryptographicHash hash(QCryptographicHash::Sha1);
+        for (int i = begin; i < end; i++)
+        {
+            hash.addData(annotatedLines[i].line.toUtf8());
+            hash.addData("\n", 1);
+        }
+        segment.hash = hash.result();
+        segments.push_back(std::move(segment));
+    };
+
+    int gapBegin = 0;
+    for (int i = 0; i < annotatedLines.size(); i++)
+    {
+        const auto& annotation = annotatedLines[i].annotation;
+        if (annotation.type != AnnotationType::Function)
+            continue;
+
+        // A function ends with its declaration, the closing brace of the body or a body that was
+        // not materialized (define ... {})
+        int end = i;
+        while (end < annotatedLines.size())
+        {
+            const auto& line = annotatedLines[end++].line;
+            if (line.startsWith("declare") || line == "}" || (line.startsWith("define") && line.endsWith("{}")))
+                break;
+        }
+        addSegment(nullptr, gapBegin, i);
+        addSegment((const llvm::Function*)annotation.ptr, i, end);
+        gapBegin = end;
+        i = end - 1;
+    }
+    addSegment(nullptr, gapBegin, annotatedLines.size());
+    return segments;
+}
+
+ParsedModulePtr BitcodeDialog::parse(const QString& type, const QString& title, const QByteArray& data, bool lazy)
+{
+    auto module = std::make_shared<ParsedModule>();
+    module->type = type;
+    module->title = title;
+    module->size = data.size();
+    // "bitcode" is sent by REVIDE::Dump in its compact format, "module" can be either
+    auto bitcode = type == "bitcode";
+    if (type != "module" && !bitcode)
+    {
+        module->errorMessage = QString("Unsupported type '%1'").arg(type);
+        return module;
+    }
+
+    auto bytes = reinterpret_cast<const unsigned char*>(data.constData());
+    auto isBitcode = bitcode || llvm::isBitcode(bytes, bytes + data.size());
+    module->outline = lazy && isBitcode;
+
+    auto& metrics = Metrics::instance();
+    auto context = std::make_unique<LLVMGlobalContext>();
+    bool parsed;
+    {
+        Metrics::Timer timer(metrics.parse);
+        parsed = context->Parse(data, isBitcode, module->outline, module->errorMessage, module->errorLine, module->errorColumn);
+    }
+    if (!parsed)
+    {
+        module->outline = false;
+        // The data might point into a spool file that is gone by the time the editor shows it
+        if (isBitcode)
+            module->errorText = module->errorMessage.toUtf8();
+        else
+            module->errorText = QByteArray(data.constData(), data.size());
+        return module;
+    }
+    auto content = std::make_shared<ModuleContent>();
+    {
+        Metrics::Timer timer(metrics.dump);
+        content->annotatedLines = context->Dump();
+    }
+    content->context = std::move(context);
+    for (const auto& annotatedLine : content->annotatedLines)
+        content->text += annotatedLine.line + "\n";
+    content->text.chop(1); // remove the last \n
+    content->segments = splitSegments(content->annotatedLines);
+    module->content = std::move(content);
+    return module;
+}
+
+bool BitcodeDialog::load(const ParsedModule& module, QString& errorMessage)
 {
-    if (type == "module")
+    errorMessage = module.errorMessage;
+    if (module.type == "module" || module.type == "bitcode")
     {
-        if (!mContext->Parse(data, errorMessage, mErrorLine, mErrorColumn))
+        if (!module.content)
         {
             mErrorMessage = errorMessage;
+            mErrorLine = module.errorLine;
+            mErrorColumn = module.errorColumn;
             mPlainTextBitcode->setErrorLine(mErrorLine);
-            if (data.length() > 4 && data[0] == 'B' && data[1] == 'C' && data[2] == 0xC0 && data[3] == 0xDE)
-            {
-                mPlainTextBitcode->setPlainText(errorMessage);
-            }
-            else
             {
-                mPlainTextBitcode->setPlainText(data);
+                Metrics::Timer timer(Metrics::instance().setPlainText);
+                mPlainTextBitcode->setPlainText(module.errorText);
             }
             auto cursor = mPlainTextBitcode->textCursor();
             cursor.clearSelection();
@@ -347,52 +510,25 @@ bool BitcodeDialog::load(const QString& type, const QByteArray& data, QString& e
             mPlainTextBitcode->setTextCursor(cursor);
             return false;
         }
-        mAnnotatedLines = mContext->Dump();
-        QString text;
-        mFunctionLineMap.clear();
-        mBlockLineMap.clear();
+        mContent = module.content;
+        mTitle = module.title;
+        mContext = mContent->context.get();
+        mAnnotatedLines = mContent->annotatedLines;
         mFunctionGraphs.clear();
         mBlockIdToBlock.clear();
         mBlockToBlockId.clear();
         mSelectedValue = nullptr;
-        for (const auto& annotatedLine : mAnnotatedLines)
-        {
-            auto line = annotatedLine.annotation.line;
-            text += annotatedLine.line + "\n";
-            switch (annotatedLine.annotation.type)
-            {
-            case AnnotationType::Function:
-            {
-                auto function = (llvm::Function*)annotatedLine.annotation.ptr;
-                mFunctionLineMap.emplace(function, annotatedLine.annotation.line);
-            }
-            break;
-
-            case AnnotationType::BasicBlockStart:
-            {
-                auto basicBlock = (llvm::BasicBlock*)annotatedLine.annotation.ptr;
-                if(mBlockLineMap.emplace(basicBlock, line - 1).second)
-                {
-                    auto label = annotatedLine.line.split(':')[0];
-                    if (basicBlock == &basicBlock->getParent()->getEntryBlock())
-                        label = "entry";
-                    mBlockLabelMap.emplace(basicBlock, label);
-                }
-            }
-            break;
-
-            default:
-                break;
-            }
-        }
-        text.chop(1); // remove the last \n
+        indexAnnotations();
         mPlainTextBitcode->clear();
         // auto cursor = mPlainTextBitcode->textCursor();
         // cursor.beginEditBlock();
         // cursor.insertBlock();
         // cursor.insertText(text);
         // cursor.endEditBlock();
-        mPlainTextBitcode->setPlainText(text);
+        {
+            Metrics::Timer timer(Metrics::instance().setPlainText);
+            mPlainTextBitcode->setPlainText(mContent->text);
+        }
         // mPlainTextBitcode->appendPlainText(text);
         QStringList functionList;
         functionList.reserve(mContext->Functions.size());
@@ -400,6 +536,8 @@ bool BitcodeDialog::load(const QString& type, const QByteArray& data, QString& e
             functionList << function->getName().str().c_str();
         mFunctionDialog->setFunctionList(functionList);
         qDebug() << "blockCount" << mPlainTextBitcode->blockCount();
+        updateSnapshots(module);
+        updateMetrics();
         return true;
     }
     else
@@ -408,6 +546,195 @@ bool BitcodeDialog::load(const QString& type, const QByteArray& data, QString& e
     }
 }
 
+bool BitcodeDialog::reload(const ParsedModule& module, QString& errorMessage)
+{
+    // Only patch when the same functions are in the same order
+    auto canPatch = mContent && module.content && mContent->segments.size() == module.content->segments.size();
+    for (size_t i = 0; canPatch && i < mContent->segments.size(); i++)
+    {
+        const auto& oldSegment = mContent->segments[i];
+        const auto& newSegment = module.content->segments[i];
+        canPatch = (oldSegment.function == nullptr) == (newSegment.function == nullptr) && oldSegment.name == newSegment.name;
+    }
+    if (!canPatch)
+        return load(module, errorMessage);
+
+    errorMessage = module.errorMessage;
+    auto previous = std::move(mContent); // the old functions are needed until the graphs are moved over
+    const auto& oldSegments = previous->segments;
+    const auto& newContent = *module.content;
+    const auto& newSegments = newContent.segments;
+
+    auto editorCursor = mPlainTextBitcode->textCursor();
+    auto cursorLine = editorCursor.blockNumber();
+    auto cursorColumn = editorCursor.positionInBlock();
+
+    // Replace the changed segments back to front, the line numbers of the earlier ones stay valid
+    // and the highlighter only revisits the replaced lines
+    auto document = mPlainTextBitcode->document();
+    QTextCursor cursor(document);
+    mIgnoreCursorMove = true;
+    cursor.beginEditBlock();
+    for (size_t i = oldSegments.size(); i-- > 0;)
+    {
+        const auto& oldSegment = oldSegments[i];
+        const auto& newSegment = newSegments[i];
+        if (oldSegment.hash == newSegment.hash)
+            continue;
+
+        QString text;
+        for (auto line = newSegment.begin; line < newSegment.end; line++)
+        {
+            if (line != newSegment.begin)
+                text += '\n';
+            text += newContent.annotatedLines[line].line;
+        }
+        auto last = document->findBlockByNumber(oldSegment.end - 1);
+        cursor.setPosition(document->findBlockByNumber(oldSegment.begin).position());
+        cursor.setPosition(last.position() + last.length() - 1, QTextCursor::KeepAnchor);
+        cursor.insertText(text);
+
+        // Keep the cursor on the same line of the text
+        if (cursorLine >= oldSegment.end)
+            cursorLine += (newSegment.end - newSegment.begin) - (oldSegment.end - oldSegment.begin);
+        else if (cursorLine >= oldSegment.begin)
+            cursorLine = std::min(cursorLine, newSegment.end - 1);
+    }
+    cursor.endEditBlock();
+    document->clearUndoRedoStacks();
+
+    // The text of the unchanged functions is identical, so are their blocks. Move the graphs
+    // (and with them the cached layouts) and the block ids over to the new context
+    std::unordered_map<const llvm::Function*, GenericGraphPtr> functionGraphs;
+    std::unordered_map<ut64, const llvm::BasicBlock*> blockIdToBlock;
+    std::unordered_map<const llvm::BasicBlock*, ut64> blockToBlockId;
+    for (size_t i = 0; i < oldSegments.size(); i++)
+    {
+        auto oldFunction = oldSegments[i].function;
+        auto newFunction = newSegments[i].function;
+        if (oldFunction == nullptr || oldSegments[i].hash != newSegments[i].hash)
+            continue;
+
+        auto newBlock = newFunction->begin();
+        for (const auto& oldBlock : *oldFunction)
+        {
+            auto itr = mBlockToBlockId.find(&oldBlock);
+            if (itr != mBlockToBlockId.end())
+            {
+                blockToBlockId.emplace(&*newBlock, itr->second);
+                blockIdToBlock.emplace(itr->second, &*newBlock);
+            }
+            ++newBlock;
+        }
+
+        auto graph = mFunctionGraphs.find(oldFunction);
+        if (graph != mFunctionGraphs.end())
+            functionGraphs.emplace(newFunction, graph->second);
+    }
+    mFunctionGraphs = std::move(functionGraphs);
+    mBlockIdToBlock = std::move(blockIdToBlock);
+    mBlockToBlockId = std::move(blockToBlockId);
+
+    mContent = module.content;
+    mTitle = module.title;
+    mContext = mContent->context.get();
+    mAnnotatedLines = mContent->annotatedLines;
+    mSelectedValue = nullptr;
+    indexAnnotations();
+    previous.reset();
+
+    // Shows the new graph if the function under the cursor changed
+    auto block = document->findBlockByNumber(std::min(cursorLine, document->blockCount() - 1));
+    editorCursor = QTextCursor(block);
+    editorCursor.setPosition(block.position() + std::min(cursorColumn, block.length() - 1));
+    mPlainTextBitcode->setTextCursor(editorCursor);
+    mIgnoreCursorMove = false;
+    bitcodeCursorPositionChangedSlot();
+    updateSnapshots(module);
+    updateMetrics();
+    return true;
+}
+
+void BitcodeDialog::updateMetrics()
+{
+    // The text is held by the content and by the editor, the history is compressed
+    auto memory = mContent->text.size() * qint64(sizeof(QChar)) * 2 + mSnapshots.storedBytes();
+    for (const auto& annotatedLine : mContent->annotatedLines)
+        memory += sizeof(AnnotatedLine) + annotatedLine.line.size() * qint64(sizeof(QChar));
+    auto& metrics = Metrics::instance();
+    metrics.setTabMemory(this, windowTitle(), memory);
+    metrics.modulesShown.add();
+}
+
+void BitcodeDialog::updateSnapshots(const ParsedModule& module)
+{
+    // The complete module replaces the outline, only that one is part of the history
+    if (module.outline)
+        return;
+
+    // Materialized snapshots are part of the history already
+    mCurrentSnapshot = module.snapshot;
+    if (mCurrentSnapshot == -1)
+        mCurrentSnapshot = mSnapshots.add(*module.content, module.size);
+
+    QSignalBlocker blocker(mSliderSnapshot);
+    mSliderSnapshot->setRange(0, mSnapshots.size() - 1);
+    mSliderSnapshot->setValue(mCurrentSnapshot);
+    mSliderSnapshot->setVisible(mSnapshots.size() > 1);
+    mLabelSnapshot->setVisible(mSnapshots.size() > 1);
+    updateSnapshotLabel(mCurrentSnapshot);
+}
+
+void BitcodeDialog::updateSnapshotLabel(int snapshot)
+{
+    const auto& entry = mSnapshots.snapshot(snapshot);
+    mLabelSnapshot->setText(QString("%1/%2 %3").arg(snapshot + 1).arg(mSnapshots.size()).arg(entry.received.toString("hh:mm:ss.zzz")));
+    mLabelSnapshot->setToolTip(QString("%1 bytes received, history: %2 KiB").arg(entry.size).arg(mSnapshots.storedBytes() / 1024));
+}
+
+void BitcodeDialog::snapshotSlot(int snapshot)
+{
+    updateSnapshotLabel(snapshot);
+    if (snapshot != mCurrentSnapshot)
+        emit snapshotRequested(mSnapshots.materialize(snapshot), snapshot);
+}
+
+void BitcodeDialog::indexAnnotations()
+{
+    mFunctionLineMap.clear();
+    mBlockLineMap.clear();
+    mBlockLabelMap.clear();
+    for (const auto& annotatedLine : mAnnotatedLines)
+    {
+        auto line = annotatedLine.annotation.line;
+        switch (annotatedLine.annotation.type)
+        {
+        case AnnotationType::Function:
+        {
+            auto function = (llvm::Function*)annotatedLine.annotation.ptr;
+            mFunctionLineMap.emplace(function, annotatedLine.annotation.line);
+        }
+        break;
+
+        case AnnotationType::BasicBlockStart:
+        {
+            auto basicBlock = (llvm::BasicBlock*)annotatedLine.annotation.ptr;
+            if(mBlockLineMap.emplace(basicBlock, line - 1).second)
+            {
+                auto label = annotatedLine.line.split(':')[0];
+                if (basicBlock == &basicBlock->getParent()->getEntryBlock())
+                    label = "entry";
+                mBlockLabelMap.emplace(basicBlock, label);
+            }
+        }
+        break;
+
+        default:
+            break;
+        }
+    }
+}
+
 // TODO: do this properly https://github.com/Nanonid/rison
 static QString risonencode(const QString& s)
 {
@@ -666,6 +993,14 @@ void BitcodeDialog::bitcodeCursorPositionChangedSlot()
             auto function = (llvm::Function*)annotation.ptr;
             info2 = QString(", name: %1").arg(function->getName().str().c_str());
 
+            // The bodies of an outline are materialized when they are navigated to and shown in
+            // the graph, the text follows once the complete module is loaded
+            if (function->isMaterializable())
+            {
+                if (auto error = function->materialize())
+                    info2 += QString(", failed to materialize: %1").arg(QString::fromStdString(llvm::toString(std::move(error))));
+            }
+
             selectedFn = function;
             if (!function->empty())
                 selectedBB = &function->getEntryBlock();
@@ -767,23 +1102,73 @@ void BitcodeDialog::bitcodeCursorPositionChangedSlot()
             {
                 // Create the graph if it doesn't exist yet
                 // TODO: this isn't very performance friendly, needs to be moved to a thread pool
-                GenericGraph graph(mCurrentGraphId++);
+                GenericGraph::Builder graph(mCurrentGraphId++, QString::fromStdString(selectedFn->getName().str()), mTitle);
+
+                // Blocks that were materialized on demand are not part of the text
+                std::unique_ptr<llvm::ModuleSlotTracker> slotTracker;
+                auto print = [&](const auto& printValue)
+                {
+                    if (!slotTracker)
+                    {
+                        slotTracker = std::make_unique<llvm::ModuleSlotTracker>(selectedFn->getParent());
+                        slotTracker->incorporateFunction(*selectedFn);
+                    }
+                    std::string str;
+                    llvm::raw_string_ostream os(str);
+                    printValue(os, *slotTracker);
+                    return QString::fromStdString(os.str()).trimmed();
+                };
 
                 for (const auto& BB : *selectedFn)
                 {
                     auto name = QString::fromStdString(BB.getName().str());
                     if (name.isEmpty())
-                        name = mBlockLabelMap.at(&BB);
+                    {
+                        auto labelItr = mBlockLabelMap.find(&BB);
+                        if (labelItr != mBlockLabelMap.end())
+                            name = labelItr->second;
+                        else if (&BB == &selectedFn->getEntryBlock())
+                            name = "entry";
+                        else
+                            name = print([&BB](llvm::raw_ostream& os, llvm::ModuleSlotTracker& mst) { BB.printAsOperand(os, false, mst); }).mid(1); // without the %
+                    }
                     auto id = getBlockId(&BB);
-                    graph.addNode(id, name);
-                    // https://stackoverflow.com/a/59933151/1806760
-                    for (auto pred : llvm::predecessors(&BB))
+
+                    // Instruction lines of the block, shown inside the node when enabled
+                    QString body;
+                    auto lineItr = mBlockLineMap.find(&BB);
+                    if (lineItr == mBlockLineMap.end())
+                    {
+                        for (const auto& I : BB)
+                        {
+                            if (!body.isEmpty())
+                                body += '\n';
+                            body += print([&I](llvm::raw_ostream& os, llvm::ModuleSlotTracker& mst) { I.print(os, mst); });
+                        }
+                    }
+                    else
+                    {
+                        for (auto line = lineItr->second; line < mAnnotatedLines.size(); line++)
+                        {
+                            const auto& annotation = mAnnotatedLines[line].annotation;
+                            if (annotation.type == AnnotationType::BasicBlockEnd || annotation.type == AnnotationType::Function)
+                                break;
+                            if (annotation.type != AnnotationType::Instruction)
+                                continue;
+                            if (!body.isEmpty())
+                                body += '\n';
+                            body += mAnnotatedLines[line].line.trimmed();
+                        }
+                    }
+                    graph.addNode(id, name, body);
+                    // Successors are in terminator order, which keeps the edge order stable
+                    for (auto succ : llvm::successors(&BB))
                     {
-                        graph.addEdge(getBlockId(pred), id);
+                        graph.addEdge(id, getBlockId(succ));
                     }
                 }
 
-                foundGraph = mFunctionGraphs.emplace(selectedFn, std::move(graph)).first;
+                foundGraph = mFunctionGraphs.emplace(selectedFn, graph.build()).first;
             }
 
             mGraphDialog->graphView()->setGraph(foundGraph->second);
@@ -935,6 +1320,9 @@ void BitcodeDialog::changeEvent(QEvent* event)
             mHighlighter->refreshColors(this);
             mHighlighter->setDocument(nullptr);
             mHighlighter->setDocument(mPlainTextBitcode->document());
+            // The colored instructions in the graph nodes are cached
+            if (mGraphDialog && mGraphDialog->graphView()->showInstructions())
+                mGraphDialog->graphView()->refreshView();
         }
     }
     ads::CDockManager::changeEvent(event);
@@ -1,12 +1,18 @@
 #pragma once
 
+#include <memory>
+
+#include <QLabel>
 #include <QLineEdit>
 #include <QPushButton>
+#include <QSlider>
 
 #include "CodeEditor.h"
 #include "Styled.h"
 #include "GraphDialog.h"
 #include "DockManager.h"
+#include "SnapshotStore.h"
+#include "ModuleProvenance.h"
 
 class BitcodeHighlighter;
 class FunctionDialog;
@@ -53,6 +59,56 @@ struct AnnotatedLine
     Annotation annotation;
 };
 
+// Module parsed (and dumped) in its own LLVMContext, immutable once parsed so identical
+// payloads can share it between dialogs
+struct ModuleContent
+{
+    ModuleContent();
+    ~ModuleContent();
+
+    // Lines of a single function, or the text between two functions (function == nullptr)
+    struct Segment
+    {
+        const llvm::Function* function = nullptr;
+        QString name;
+        int begin = 0;
+        int end = 0;
+        QByteArray hash; // of the text, equal hashes mean the function did not change
+    };
+
+    std::unique_ptr<LLVMGlobalContext> context;
+    QVector<AnnotatedLine> annotatedLines;
+    QString text; // annotatedLines joined, shown in the editor
+    std::vector<Segment> segments; // in text order, covering all the lines
+};
+
+using ModuleContentPtr = std::shared_ptr<const ModuleContent>;
+
+// Result of BitcodeDialog::parse for a single payload
+struct ParsedModule
+{
+    QString type;
+    QString title;
+    QString path; // of a file opened by the user, empty for the dumps
+    qint64 size = 0;
+    QByteArray hash; // of the payload
+    ModuleContentPtr content; // nullptr if parsing failed
+    bool duplicate = false; // content reused from an identical module
+    int snapshot = -1; // index in the history of the tab when a snapshot was materialized
+    QString duplicateOf; // title of that module
+    ModuleProvenance provenance; // only for the modules of a batch upload
+    // Bitcode loaded lazily: the globals and function headers, the bodies are materialized when
+    // they are navigated to. The complete module follows with the same outlineId
+    bool outline = false;
+    quint64 outlineId = 0;
+    QString errorMessage;
+    int errorLine = -1;
+    int errorColumn = -1;
+    QByteArray errorText; // shown in the editor when parsing failed
+};
+
+using ParsedModulePtr = std::shared_ptr<ParsedModule>;
+
 class BitcodeDialog : public ads::CDockManager, Styled<BitcodeDialog>
 {
     Q_OBJECT
@@ -71,7 +127,19 @@ public:
 public:
     explicit BitcodeDialog(QWidget* parent = nullptr);
     ~BitcodeDialog();
-    bool load(const QString& type, const QByteArray& data, QString& errorMessage);
+    // Does not touch any widgets, safe to call from worker threads. Bitcode is only parsed as an
+    // outline when lazy is set
+    static ParsedModulePtr parse(const QString& type, const QString& title, const QByteArray& data, bool lazy = false);
+    // Shares the parsed content of the module
+    bool load(const ParsedModule& module, QString& errorMessage);
+    // Newer version of the loaded module, only the functions that changed are replaced in the
+    // editor and the graphs of the others are kept. Adding, removing or reordering functions
+    // falls back to load()
+    bool reload(const ParsedModule& module, QString& errorMessage);
+
+signals:
+    // The timeline was moved, the text has to be parsed and passed to reload()
+    void snapshotRequested(const QByteArray& text, int snapshot);
 
 protected:
     void changeEvent(QEvent* event) override;
@@ -83,9 +151,14 @@ private slots:
     void bitcodeCursorPositionChangedSlot();
     void bitcodeContextMenuSlot(const QPoint& pos);
     void followValueSlot();
+    void snapshotSlot(int snapshot);
 
 private:
     void setupMenu();
+    void indexAnnotations();
+    void updateSnapshots(const ParsedModule& module);
+    void updateSnapshotLabel(int snapshot);
+    void updateMetrics();
     ut64 getBlockId(const llvm::BasicBlock* block);
     void gotoLine(int line, bool centerInView);
 
@@ -94,9 +167,13 @@ private:
     QLineEdit* mLineEditStatus = nullptr;
     QPushButton* mButtonGodbolt = nullptr;
     QPushButton* mButtonHelp = nullptr;
+    QSlider* mSliderSnapshot = nullptr;
+    QLabel* mLabelSnapshot = nullptr;
     QAction* mFollowValue = nullptr;
 
-    LLVMGlobalContext* mContext = nullptr;
+    ModuleContentPtr mContent;
+    QString mTitle; // the graph layouts are remembered per module title and function
+    LLVMGlobalContext* mContext = nullptr; // owned by mContent
     BitcodeHighlighter* mHighlighter = nullptr;
     QVector<AnnotatedLine> mAnnotatedLines;
     std::unordered_map<const llvm::Function*, int> mFunctionLineMap;
@@ -106,8 +183,8 @@ private:
     int mErrorLine = -1, mErrorColumn = -1;
     FunctionDialog* mFunctionDialog;
     DocumentationDialog* mDocumentationDialog;
-    GraphDialog* mGraphDialog;
-    std::unordered_map<const llvm::Function*, GenericGraph> mFunctionGraphs;
+    GraphDialog* mGraphDialog = nullptr;
+    std::unordered_map<const llvm::Function*, GenericGraphPtr> mFunctionGraphs;
     std::unordered_map<ut64, const llvm::BasicBlock*> mBlockIdToBlock;
     std::unordered_map<const llvm::BasicBlock*, ut64> mBlockToBlockId;
     ut64 mCurrentBlockId = 0;
@@ -115,4 +192,6 @@ private:
     bool mIgnoreCursorMove = false;
     ads::CDockManager* mDockManager = nullptr;
     llvm::Value* mSelectedValue = nullptr;
+    SnapshotStore mSnapshots;
+    int mCurrentSnapshot = -1;
 };
@@ -1,4 +1,5 @@
 #include "BitcodeHighlighter.h"
+#include "Metrics.h"
 
 BitcodeHighlighter::BitcodeHighlighter(const BitcodeDialog* style, QTextDocument* parent)
     : QSyntaxHighlighter(parent)
@@ -312,8 +313,43 @@ void BitcodeHighlighter::refreshColors(const BitcodeDialog* style)
         .color(style->commentColor);
 }
 
+RichTextPainter::List BitcodeHighlighter::highlightLine(const QString& text, const QColor& textColor) const
+{
+    // Rules are applied in order, the last matching rule determines the format of a character
+    std::vector<const QTextCharFormat*> formats(text.length(), nullptr);
+    for (const HighlightingRule& rule : qAsConst(highlightingRules))
+    {
+        QRegularExpressionMatchIterator matchIterator = rule.pattern.globalMatch(text);
+        while (matchIterator.hasNext())
+        {
+            QRegularExpressionMatch match = matchIterator.next();
+            for (int i = match.capturedStart(); i < match.capturedEnd(); i++)
+                formats[i] = &rule.format;
+        }
+    }
+
+    // Merge runs of characters with the same format
+    RichTextPainter::List richText;
+    for (int start = 0; start < text.length();)
+    {
+        auto format = formats[start];
+        int end = start + 1;
+        while (end < text.length() && formats[end] == format)
+            end++;
+
+        RichTextPainter::CustomRichText_t run;
+        run.text = text.mid(start, end - start);
+        run.textColor = format != nullptr && format->hasProperty(QTextFormat::ForegroundBrush) ? format->foreground().color() : textColor;
+        run.flags = RichTextPainter::FlagColor;
+        richText.push_back(std::move(run));
+        start = end;
+    }
+    return richText;
+}
+
 void BitcodeHighlighter::highlightBlock(const QString& text)
 {
+    Metrics::Timer timer(Metrics::instance().highlightBlock);
     for (const HighlightingRule& rule : qAsConst(highlightingRules))
     {
         QRegularExpressionMatchIterator matchIterator = rule.pattern.globalMatch(text);
@@ -5,6 +5,7 @@
 #include <QTextCharFormat>
 #include <QRegularExpression>
 #include "BitcodeDialog.h"
+#include "common/RichTextPainter.h"
 
 QT_BEGIN_NAMESPACE
 class QTextDocument;
@@ -17,6 +18,8 @@ class BitcodeHighlighter : public QSyntaxHighlighter
 public:
     BitcodeHighlighter(const BitcodeDialog* style, QTextDocument* parent = 0);
     void refreshColors(const BitcodeDialog* style);
+    // Colors a single line with the same rules, used outside of the text editor (e.g. graph nodes)
+    RichTextPainter::List highlightLine(const QString& text, const QColor& textColor) const;
 
 protected:
     void highlightBlock(const QString& text) override;
@@ -2,15 +2,289 @@
 #include "ui_GraphDialog.h"
 #include "FunctionListModel.h"
 #include "QtHelpers.h"
+#include "Metrics.h"
 
 #include <QTimer>
 #include <QMessageBox>
+#include <QSettings>
+
+#include <unordered_map>
 
 #include "widgets/SimpleTextGraphView.h"
+#include "common/Configuration.h"
 
 GenericGraphView::GenericGraphView(QWidget* parent)
     : SimpleTextGraphView(parent, nullptr /* fake MainWindow */)
+    , mActionShowInstructions(tr("Show instructions"), this)
+{
+    // Memory budget for the laid out graphs of this view
+    auto budgetMb = QSettings().value("GraphCacheMB", 64).toULongLong();
+    mLayoutCache.setBudget(budgetMb * 1024 * 1024);
+
+    mShowInstructions = QSettings().value("GraphShowInstructions", false).toBool();
+    mActionShowInstructions.setCheckable(true);
+    mActionShowInstructions.setChecked(mShowInstructions);
+    connect(&mActionShowInstructions, &QAction::toggled, this, &GenericGraphView::setShowInstructions);
+    contextMenu->addAction(&mActionShowInstructions);
+
+    // The blocks of every view change size, the remembered layouts cannot be matched anymore
+    connect(Config(), &Configuration::fontsUpdated, this, []()
+        {
+            layoutHistory().clear();
+        });
+}
+
+void GenericGraphView::setLineHighlighter(LineHighlighter highlighter)
+{
+    mLineHighlighter = std::move(highlighter);
+    if(mShowInstructions)
+        refreshView();
+}
+
+void GenericGraphView::setShowInstructions(bool enabled)
+{
+    if(enabled == mShowInstructions)
+        return;
+
+    mShowInstructions = enabled;
+    QSettings().setValue("GraphShowInstructions", enabled);
+    mActionShowInstructions.setChecked(enabled);
+    // The block sizes change, none of the cached layouts can be used
+    refreshView();
+}
+
+void GenericGraphView::setGraph(GenericGraphPtr graph)
+{
+    // Do not rebuild the current graph unnecessarily
+    if(graph == mGraph || (graph && mGraph && graph->id() == mGraph->id()))
+        return;
+
+    storeLayout();
+    mGraph = std::move(graph);
+    if(mGraph && restoreLayout(mGraph->id()))
+        return;
+
+    SimpleTextGraphView::refreshView();
+}
+
+void GenericGraphView::refreshView()
+{
+    // Fonts or layout options changed, the cached layouts of this view are stale. The shared
+    // history is only used when the block sizes and the layout type match
+    mLayoutCache.clear();
+    SimpleTextGraphView::refreshView();
+}
+
+void GenericGraphView::updateLayout()
+{
+    mLayoutCache.clear();
+    SimpleTextGraphView::updateLayout();
+}
+
+void GenericGraphView::storeLayout()
+{
+    if(!mGraph || blocks.empty())
+        return;
+
+    storeLayoutHistory(true);
+
+    CachedLayout layout;
+    layout.graph = mGraph;
+    layout.blocks = std::move(blocks);
+    layout.blockContent = std::move(blockContent);
+    layout.blockInstructions = std::move(mBlockInstructions);
+    layout.width = width;
+    layout.height = height;
+    layout.offset = getViewOffset();
+    layout.scale = getViewScale();
+    blocks.clear();
+    blockContent.clear();
+    mBlockInstructions.clear();
+
+    auto cost = layoutCost(layout);
+    mLayoutCache.insert(mGraph->id(), std::move(layout), cost);
+}
+
+bool GenericGraphView::restoreLayout(ut64 graphId)
+{
+    CachedLayout layout;
+    if(!mLayoutCache.take(graphId, layout))
+        return false;
+
+    blocks = std::move(layout.blocks);
+    blockContent = std::move(layout.blockContent);
+    mBlockInstructions = std::move(layout.blockInstructions);
+    width = layout.width;
+    height = layout.height;
+    if(mGraph->nodeCount() > 0)
+        setEntry(mGraph->nodeId(0));
+    if(blockContent.find(selectedBlock) == blockContent.end())
+        selectedBlock = NO_BLOCK_SELECTED;
+
+    setViewScale(layout.scale);
+    setViewOffset(layout.offset);
+    setCacheDirty();
+    viewport()->update();
+    emit viewRefreshed();
+    return true;
+}
+
+size_t GenericGraphView::layoutCost(const CachedLayout& layout)
+{
+    // Rough estimate of the heap memory owned by the layout
+    size_t cost = sizeof(CachedLayout);
+    for(const auto& itr : layout.blocks)
+    {
+        const auto& block = itr.second;
+        cost += sizeof(itr) + 2 * sizeof(void*);
+        cost += block.edges.capacity() * sizeof(GraphEdge);
+        for(const auto& edge : block.edges)
+            cost += edge.polyline.capacity() * sizeof(QPointF);
+    }
+    // The shaped text keeps a glyph index and a position per character
+    for(const auto& itr : layout.blockContent)
+        cost += sizeof(itr) + 2 * sizeof(void*) + itr.second.text.capacity() * sizeof(QChar) + itr.second.text.length() * 3 * sizeof(int);
+    for(const auto& itr : layout.blockInstructions)
+    {
+        cost += sizeof(itr) + 2 * sizeof(void*);
+        for(const auto& line : itr.second.lines)
+        {
+            cost += line.capacity() * sizeof(RichTextPainter::CustomRichText_t);
+            for(const auto& text : line)
+                cost += text.text.capacity() * sizeof(QChar);
+        }
+    }
+    return cost;
+}
+
+GenericGraphPtr GenericGraph::Builder::build()
 {
+    auto graph = std::shared_ptr<GenericGraph>(new GenericGraph());
+    graph->mId = mId;
+    graph->mName = std::move(mName);
+    graph->mScope = std::move(mScope);
+    graph->mNodeIds = std::move(mNodeIds);
+    graph->mLabelPool = std::move(mLabelPool);
+    graph->mLabelOffsets = std::move(mLabelOffsets);
+    graph->mLabelOffsets.push_back(graph->mLabelPool.length());
+    graph->mBodyPool = std::move(mBodyPool);
+    graph->mBodyOffsets = std::move(mBodyOffsets);
+    graph->mBodyOffsets.push_back(graph->mBodyPool.length());
+
+    auto nodeCount = graph->mNodeIds.size();
+    graph->mNodeLookup.reserve(nodeCount);
+    for(size_t i = 0; i < nodeCount; i++)
+        graph->mNodeLookup.emplace_back(graph->mNodeIds[i], uint32_t(i));
+    std::sort(graph->mNodeLookup.begin(), graph->mNodeLookup.end());
+
+    // Count the edges per source node to get the row offsets
+    std::vector<std::pair<uint32_t, ut64>> edges;
+    edges.reserve(mEdges.size());
+    auto& offsets = graph->mEdgeOffsets;
+    offsets.assign(nodeCount + 1, 0);
+    for(const auto& edge : mEdges)
+    {
+        auto from = graph->nodeIndex(edge.first);
+        if(from == -1)
+            continue;
+        edges.emplace_back(uint32_t(from), edge.second);
+        offsets[from + 1]++;
+    }
+    for(size_t i = 0; i < nodeCount; i++)
+        offsets[i + 1] += offsets[i];
+
+    // Scatter the targets into their rows (keeping the insertion order)
+    auto& targets = graph->mEdgeTargets;
+    targets.resize(edges.size());
+    std::vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+    for(const auto& edge : edges)
+        targets[cursor[edge.first]++] = edge.second;
+
+    // Remove duplicate edges and compact the rows
+    uint32_t write = 0;
+    for(size_t i = 0; i < nodeCount; i++)
+    {
+        auto begin = offsets[i], end = offsets[i + 1];
+        offsets[i] = write;
+        for(auto j = begin; j < end; j++)
+        {
+            auto rowBegin = targets.begin() + offsets[i];
+            auto rowEnd = targets.begin() + write;
+            if(std::find(rowBegin, rowEnd, targets[j]) == rowEnd)
+                targets[write++] = targets[j];
+        }
+    }
+    offsets[nodeCount] = write;
+    targets.resize(write);
+    targets.shrink_to_fit();
+
+    mEdges.clear();
+    return graph;
+}
+
+void GenericGraphView::addInstructions(ut64 id, const QString& body)
+{
+    if(body.isEmpty())
+        return;
+
+    auto& instructions = mBlockInstructions[id];
+    auto maxChars = Config()->getGraphBlockMaxChars();
+    auto textColor = palette().color(QPalette::WindowText);
+    qreal maxWidth = 0;
+    for(const auto& line : body.split('\n'))
+    {
+        RichTextPainter::List richText;
+        if(mLineHighlighter)
+        {
+            richText = mLineHighlighter(line, textColor);
+        }
+        else
+        {
+            RichTextPainter::CustomRichText_t text;
+            text.text = line;
+            text.textColor = textColor;
+            text.flags = RichTextPainter::FlagColor;
+            richText.push_back(std::move(text));
+        }
+
+        // Long lines are cropped to keep the blocks readable
+        richText = RichTextPainter::cropped(richText, maxChars, "...");
+        qreal width = 0;
+        for(const auto& text : richText)
+            width += mFontMetrics->width(text.text);
+        maxWidth = std::max(maxWidth, width);
+        instructions.lines.push_back(std::move(richText));
+    }
+
+    // The size is computed once here, painting doesn't measure the text again
+    auto& block = blocks[id];
+    block.width = std::max(block.width, static_cast<int>(maxWidth + padding));
+    block.height += static_cast<int>(instructions.lines.size()) * charHeight;
+}
+
+void GenericGraphView::drawBlock(QPainter& p, GraphView::GraphBlock& block, bool interactive)
+{
+    // Background and label
+    SimpleTextGraphView::drawBlock(p, block, interactive);
+
+    auto itr = mBlockInstructions.find(block.entry);
+    if(itr == mBlockInstructions.end())
+        return;
+
+    // Stop rendering text when it's too small
+    auto transform = p.combinedTransform();
+    QRect screenChar = transform.mapRect(QRect(0, 0, ACharWidth, charHeight));
+    if(screenChar.width() < Config()->getGraphMinFontSize())
+        return;
+
+    qreal x = block.x + padding / 2;
+    qreal y = block.y + padding / 2 + charHeight;
+    qreal width = block.width - padding;
+    for(const auto& line : itr->second.lines)
+    {
+        RichTextPainter::paintRichText<qreal>(&p, x, y, width, charHeight, 0, line, mFontMetrics.get());
+        y += charHeight;
+    }
 }
 
 void GenericGraphView::loadCurrentGraph()
@@ -20,27 +294,35 @@ void GenericGraphView::loadCurrentGraph()
 
     blockContent.clear();
     blocks.clear();
+    mBlockInstructions.clear();
 
-    std::unordered_set<ut64> edges;
-    for(const auto& node : mGraph.mNodes)
+    if(!mGraph)
+        return;
+
+    blockContent.reserve(mGraph->nodeCount());
+    blocks.reserve(mGraph->nodeCount());
+
+    std::vector<ut64> unknownTargets;
+    for(size_t i = 0; i < mGraph->nodeCount(); i++)
     {
         GraphLayout::GraphBlock block;
-        block.entry = node.first;
+        block.entry = mGraph->nodeId(i);
 
-        auto edgesItr = mGraph.mEdges.find(block.entry);
-        if(edgesItr != mGraph.mEdges.end())
+        block.edges.reserve(mGraph->edgesEnd(i) - mGraph->edgesBegin(i));
+        for(auto to = mGraph->edgesBegin(i); to != mGraph->edgesEnd(i); ++to)
         {
-            for(const auto& to : edgesItr->second)
-            {
-                block.edges.emplace_back(to);
-                edges.insert(to);
-            }
+            block.edges.emplace_back(*to);
+            if(mGraph->nodeIndex(*to) == -1)
+                unknownTargets.push_back(*to);
         }
 
-        addBlock(std::move(block), node.second, node.first);
+        auto id = block.entry;
+        addBlock(std::move(block), mGraph->nodeLabel(i), id);
+        if(mShowInstructions)
+            addInstructions(id, mGraph->nodeBody(i));
     }
 
-    for(const auto& x : edges) {
+    for(const auto& x : unknownTargets) {
         if(blockContent.find(x) != blockContent.end()) {
             // Already visited
             continue;
@@ -52,14 +334,358 @@ void GenericGraphView::loadCurrentGraph()
         addBlock(block, QString("unknown_%1").arg(RzHexString(x)), x);
     }
 
-    computeGraphPlacement();
+    // The first node is the entry of the graph
+    if(mGraph->nodeCount() > 0)
+        setEntry(mGraph->nodeId(0));
+
+    // Start from the previous layout of the same function (if there is one)
+    const LayoutHistory* history = nullptr;
+    if(!mGraph->name().isEmpty())
+        history = layoutHistory().find(layoutHistoryKey());
+    if(history != nullptr && (history->layout != graphLayout || history->horizontal != horizontalLayoutAction->isChecked()))
+        history = nullptr;
+
+    {
+        Metrics::Timer timer(Metrics::instance().graphLayout);
+        if(history == nullptr || (!applyLayoutHistory(*history) && !placeChangedBlocks(*history)))
+            computeGraphPlacement();
+    }
+
+    if(history != nullptr && history->hasView)
+    {
+        anchorToLayoutHistory(*history);
+        storeLayoutHistory(true);
+    }
+    else
+    {
+        storeLayoutHistory(false);
+
+        // TODO: this doesn't seem to always work right away
+        QTimer::singleShot(0, [this]
+            {
+                center();
+            });
+    }
+}
+
+LruCache<std::string, GenericGraphView::LayoutHistory>& GenericGraphView::layoutHistory()
+{
+    static LruCache<std::string, LayoutHistory> history(QSettings().value("GraphHistoryMB", 16).toULongLong() * 1024 * 1024);
+    return history;
+}
+
+std::string GenericGraphView::layoutHistoryKey() const
+{
+    return (mGraph->scope() + '\n' + mGraph->name()).toStdString();
+}
+
+void GenericGraphView::storeLayoutHistory(bool withView)
+{
+    if(!mGraph || mGraph->name().isEmpty())
+        return;
+
+    LayoutHistory history;
+    history.blocks.reserve(blocks.size());
+    for(const auto& itr : blocks)
+    {
+        // The blocks are matched by label, with duplicates the next dump would be laid out wrong
+        const auto& label = blockContent[itr.first].text;
+        if(history.lookup.contains(label))
+        {
+            layoutHistory().remove(layoutHistoryKey());
+            return;
+        }
+        history.lookup.insert(label, int(history.blocks.size()));
+        history.blocks.push_back(itr.second);
+    }
+
+    // Store the edge targets as indices so they can be matched by label
+    size_t cost = sizeof(LayoutHistory);
+    for(auto& block : history.blocks)
+    {
+        block.entry = history.lookup.value(blockContent[block.entry].text);
+        for(auto& edge : block.edges)
+        {
+            edge.target = history.lookup.value(blockContent[edge.target].text, -1);
+            cost += sizeof(GraphEdge) + edge.polyline.size() * sizeof(QPointF);
+        }
+        cost += sizeof(GraphBlock) + 64;
+    }
+    history.layout = graphLayout;
+    history.horizontal = horizontalLayoutAction->isChecked();
+    history.width = width;
+    history.height = height;
+    history.hasView = withView;
+    history.offset = getViewOffset();
+    history.scale = getViewScale();
+    layoutHistory().insert(layoutHistoryKey(), std::move(history), cost);
+}
+
+bool GenericGraphView::applyLayoutHistory(const LayoutHistory& history)
+{
+    if(history.blocks.size() != blocks.size())
+        return false;
+
+    // Only reuse the layout if every block and edge matches by label
+    std::vector<std::pair<GraphBlock*, const GraphBlock*>> matches;
+    matches.reserve(blocks.size());
+    std::vector<bool> used(history.blocks.size());
+    for(auto& itr : blocks)
+    {
+        auto index = history.lookup.value(blockContent[itr.first].text, -1);
+        if(index == -1 || used[index])
+            return false;
+        used[index] = true;
+
+        const auto& previous = history.blocks[index];
+        const auto& block = itr.second;
+        if(previous.width != block.width || previous.height != block.height || previous.edges.size() != block.edges.size())
+            return false;
+
+        for(size_t i = 0; i < block.edges.size(); i++)
+        {
+            auto target = history.lookup.value(blockContent[block.edges[i].target].text, -1);
+            if(ut64(target) != previous.edges[i].target)
+                return false;
+        }
+        matches.emplace_back(&itr.second, &previous);
+    }
+
+    for(auto& match : matches)
+    {
+        auto& block = *match.first;
+        block.x = match.second->x;
+        block.y = match.second->y;
+        for(size_t i = 0; i < block.edges.size(); i++)
+        {
+            block.edges[i].polyline = match.second->edges[i].polyline;
+            block.edges[i].arrow = match.second->edges[i].arrow;
+        }
+    }
+    width = history.width;
+    height = history.height;
+    return true;
+}
+
+bool GenericGraphView::placeChangedBlocks(const LayoutHistory& history)
+{
+    // Keep the matched blocks where they were and only place the new and resized ones. When a
+    // big part of the function changed the full layout gives a better picture
+    std::unordered_map<ut64, int> previousIndex; // block id -> index in history.blocks
+    std::vector<bool> used(history.blocks.size());
+    std::vector<ut64> changed;
+    size_t resized = 0;
+    for(const auto& itr : blocks)
+    {
+        auto index = history.lookup.value(blockContent[itr.first].text, -1);
+        if(index == -1 || used[index])
+        {
+            changed.push_back(itr.first);
+            continue;
+        }
+        used[index] = true;
+        previousIndex.emplace(itr.first, index);
+
+        const auto& previous = history.blocks[index];
+        if(previous.width != itr.second.width || previous.height != itr.second.height)
+            resized++;
+    }
+    if(previousIndex.empty() || changed.size() + resized > std::max<size_t>(2, blocks.size() / 4))
+        return false;
+
+    const int spacing = getLayoutConfig().blockVerticalSpacing;
+    std::vector<GraphBlock*> placed;
+    placed.reserve(blocks.size());
+    auto pushDown = [&placed](int fromY, int distance)
+    {
+        for(auto block : placed)
+            if(block->y >= fromY)
+                block->y += distance;
+    };
+
+    // Matched blocks stay centered on their previous position
+    std::vector<std::pair<GraphBlock*, const GraphBlock*>> grown;
+    for(const auto& [id, index] : previousIndex)
+    {
+        auto& block = blocks[id];
+        const auto& previous = history.blocks[index];
+        block.x = previous.x + (previous.width - block.width) / 2;
+        block.y = previous.y;
+        placed.push_back(&block);
+        if(block.height > previous.height)
+            grown.emplace_back(&block, &previous);
+    }
+
+    // Make room below the blocks that got taller (top to bottom, pushing only moves the blocks below)
+    std::sort(grown.begin(), grown.end(), [](const auto& a, const auto& b)
+        {
+            return a.first->y < b.first->y;
+        });
+    for(const auto& [block, previous] : grown)
+        pushDown(block->y + previous->height, block->height - previous->height);
+
+    // New blocks go below their lowest placed predecessor, in graph order with the fake nodes last
+    std::unordered_map<ut64, std::vector<ut64>> predecessors;
+    for(const auto& itr : blocks)
+        for(const auto& edge : itr.second.edges)
+            predecessors[edge.target].push_back(itr.first);
+    std::sort(changed.begin(), changed.end(), [this](ut64 a, ut64 b)
+        {
+            return size_t(mGraph->nodeIndex(a)) < size_t(mGraph->nodeIndex(b));
+        });
+    std::unordered_map<ut64, bool> isPlaced;
+    for(auto block : placed)
+        isPlaced[block->entry] = true;
+    while(!changed.empty())
+    {
+        auto remaining = changed.size();
+        for(auto itr = changed.begin(); itr != changed.end();)
+        {
+            const GraphBlock* parent = nullptr;
+            for(auto id : predecessors[*itr])
+            {
+                if(!isPlaced[id])
+                    continue;
+                const auto& candidate = blocks[id];
+                if(parent == nullptr || candidate.y + candidate.height > parent->y + parent->height)
+                    parent = &candidate;
+            }
+            if(parent == nullptr)
+            {
+                ++itr;
+                continue;
+            }
+
+            auto& block = blocks[*itr];
+            block.x = parent->x + (parent->width - block.width) / 2;
+            block.y = parent->y + parent->height + spacing;
+            pushDown(block.y, block.height + spacing);
+            placed.push_back(&block);
+            isPlaced[block.entry] = true;
+            itr = changed.erase(itr);
+        }
+        if(changed.size() == remaining)
+            return false;
+    }
+
+    int minX = 0;
+    for(auto block : placed)
+        minX = std::min(minX, block->x);
+    for(auto block : placed)
+        block->x -= minX;
 
-    // TODO: this doesn't seem to always work right away
-    QTimer::singleShot(0, [this]
+    // Give up on overlapping blocks (e.g. a block that got wider than the gap to its neighbor)
+    std::sort(placed.begin(), placed.end(), [](const GraphBlock* a, const GraphBlock* b)
         {
-            center();
+            return a->y < b->y;
         });
+    for(size_t i = 0; i < placed.size(); i++)
+    {
+        const auto& a = *placed[i];
+        for(size_t j = i + 1; j < placed.size() && placed[j]->y < a.y + a.height; j++)
+        {
+            const auto& b = *placed[j];
+            if(b.x < a.x + a.width && a.x < b.x + b.width)
+                return false;
+        }
+    }
+
+    // Edges between unchanged blocks that moved together keep their route, the rest is routed
+    // straight down (or around the right side when going up)
+    width = 0;
+    height = 0;
+    for(auto& itr : blocks)
+    {
+        auto& block = itr.second;
+        auto fromItr = previousIndex.find(itr.first);
+        const GraphBlock* from = fromItr == previousIndex.end() ? nullptr : &history.blocks[fromItr->second];
+        for(auto& edge : block.edges)
+        {
+            const auto& target = blocks[edge.target];
+            auto toItr = previousIndex.find(edge.target);
+            const GraphBlock* to = toItr == previousIndex.end() ? nullptr : &history.blocks[toItr->second];
+
+            const GraphEdge* previousEdge = nullptr;
+            if(from != nullptr && to != nullptr
+                && from->width == block.width && from->height == block.height
+                && to->width == target.width && to->height == target.height
+                && block.x - from->x == target.x - to->x && block.y - from->y == target.y - to->y)
+            {
+                for(const auto& candidate : from->edges)
+                {
+                    if(candidate.target == ut64(toItr->second))
+                    {
+                        previousEdge = &candidate;
+                        break;
+                    }
+                }
+            }
+
+            if(previousEdge != nullptr)
+            {
+                edge.polyline = previousEdge->polyline.translated(block.x - from->x, block.y - from->y);
+                edge.arrow = previousEdge->arrow;
+            }
+            else
+            {
+                QPointF start(block.x + block.width / 2, block.y + block.height);
+                QPointF end(target.x + target.width / 2, target.y);
+                edge.polyline.clear();
+                edge.polyline << start;
+                if(end.y() > start.y())
+                {
+                    qreal middle = (start.y() + end.y()) / 2;
+                    edge.polyline << QPointF(start.x(), middle) << QPointF(end.x(), middle);
+                }
+                else
+                {
+                    qreal right = std::max(block.x + block.width, target.x + target.width) + spacing / 2;
+                    qreal below = start.y() + spacing / 2;
+                    qreal above = end.y() - spacing / 2;
+                    edge.polyline << QPointF(start.x(), below) << QPointF(right, below) << QPointF(right, above) << QPointF(end.x(), above);
+                }
+                edge.polyline << end;
+                edge.arrow = GraphEdge::Down;
+            }
+
+            for(const auto& point : edge.polyline)
+            {
+                width = std::max(width, int(point.x()) + 1);
+                height = std::max(height, int(point.y()) + 1);
+            }
+        }
+        width = std::max(width, block.x + block.width);
+        height = std::max(height, block.y + block.height);
+    }
+    return true;
 }
+
+void GenericGraphView::anchorToLayoutHistory(const LayoutHistory& history)
+{
+    // Keep the selected block (or the entry) at the same place on the screen
+    const GraphBlock* anchor = nullptr;
+    const GraphBlock* previous = nullptr;
+    ut64 candidates[] = { selectedBlock, mGraph->nodeCount() > 0 ? mGraph->nodeId(0) : selectedBlock };
+    for(auto id : candidates)
+    {
+        auto blockItr = blocks.find(id);
+        if(blockItr == blocks.end())
+            continue;
+        auto index = history.lookup.value(blockContent[id].text, -1);
+        if(index == -1)
+            continue;
+        anchor = &blockItr->second;
+        previous = &history.blocks[index];
+        break;
+    }
+
+    setViewScale(history.scale);
+    if(anchor != nullptr)
+        setViewOffset(history.offset + QPoint(anchor->x - previous->x, anchor->y - previous->y));
+    else
+        center();
+}
+
 void GenericGraphView::blockClicked(GraphView::GraphBlock& block, QMouseEvent* event, QPoint pos)
 {
     auto oldSelection = selectedBlock;
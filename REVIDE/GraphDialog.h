@@ -1,41 +1,110 @@
 #pragma once
 
-#include <unordered_map>
-#include <type_traits>
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
 
 #include <QDialog>
+#include <QHash>
 
 #include "widgets/SimpleTextGraphView.h"
+#include "common/RichTextPainter.h"
+#include "LruCache.h"
 
-struct GenericGraph
+// Immutable graph shared between the views, nodes are stored in insertion order
+// with a single label pool and the edges in compressed sparse row (CSR) form
+class GenericGraph
 {
-    ut64 mId = UT64_MAX; // unique id identifying this graph (used for caching)
-    std::unordered_map<ut64, QString> mNodes;
-    std::unordered_map<ut64, std::unordered_set<ut64>> mEdges;
+public:
+    class Builder;
+
+    ut64 id() const { return mId; }
+    // Stable name (e.g. the function name) used to match graphs across dumps
+    const QString& name() const { return mName; }
+    // Graphs are only matched within the same scope (e.g. the module title)
+    const QString& scope() const { return mScope; }
+    size_t nodeCount() const { return mNodeIds.size(); }
+    size_t edgeCount() const { return mEdgeTargets.size(); }
+    ut64 nodeId(size_t index) const { return mNodeIds[index]; }
+
+    QString nodeLabel(size_t index) const
+    {
+        auto offset = mLabelOffsets[index];
+        return mLabelPool.mid(offset, mLabelOffsets[index + 1] - offset);
+    }
 
-    GenericGraph() = default;
-    explicit GenericGraph(ut64 id) : mId(id) { }
+    // Optional contents of the node (e.g. the instructions of a basic block), one line per row
+    QString nodeBody(size_t index) const
+    {
+        auto offset = mBodyOffsets[index];
+        return mBodyPool.mid(offset, mBodyOffsets[index + 1] - offset);
+    }
 
-    void addNode(ut64 id, const QString& text, const std::unordered_set<ut64>& edges = {})
+    const ut64* edgesBegin(size_t index) const { return mEdgeTargets.data() + mEdgeOffsets[index]; }
+    const ut64* edgesEnd(size_t index) const { return mEdgeTargets.data() + mEdgeOffsets[index + 1]; }
+
+    // Returns the node index or -1 if the id is not part of the graph
+    ptrdiff_t nodeIndex(ut64 id) const
     {
-        mNodes.emplace(id, text);
-        for(const auto& to : edges)
-            addEdge(id, to);
+        auto itr = std::lower_bound(mNodeLookup.begin(), mNodeLookup.end(), std::make_pair(id, uint32_t(0)));
+        if(itr == mNodeLookup.end() || itr->first != id)
+            return -1;
+        return itr->second;
     }
 
-    void addEdge(ut64 from, ut64 to)
+private:
+    GenericGraph() = default;
+
+    ut64 mId = UT64_MAX; // unique id identifying this graph (used for caching)
+    QString mName;
+    QString mScope;
+    std::vector<ut64> mNodeIds;
+    std::vector<std::pair<ut64, uint32_t>> mNodeLookup; // sorted (id, index)
+    QString mLabelPool;
+    std::vector<uint32_t> mLabelOffsets; // nodeCount() + 1 entries
+    QString mBodyPool;
+    std::vector<uint32_t> mBodyOffsets; // nodeCount() + 1 entries
+    std::vector<uint32_t> mEdgeOffsets; // nodeCount() + 1 entries
+    std::vector<ut64> mEdgeTargets;
+};
+
+using GenericGraphPtr = std::shared_ptr<const GenericGraph>;
+
+class GenericGraph::Builder
+{
+public:
+    explicit Builder(ut64 id, const QString& name = QString(), const QString& scope = QString()) : mId(id), mName(name), mScope(scope) { }
+
+    void addNode(ut64 id, const QString& text, const QString& body = QString())
     {
-        mEdges[from].emplace(to);
+        mNodeIds.push_back(id);
+        mLabelOffsets.push_back(mLabelPool.length());
+        mLabelPool += text;
+        mBodyOffsets.push_back(mBodyPool.length());
+        mBodyPool += body;
     }
 
-    void clear()
+    void addEdge(ut64 from, ut64 to)
     {
-        mNodes.clear();
-        mEdges.clear();
+        mEdges.emplace_back(from, to);
     }
+
+    // Edges from unknown nodes are dropped, duplicate edges are merged
+    GenericGraphPtr build();
+
+private:
+    ut64 mId = UT64_MAX;
+    QString mName;
+    QString mScope;
+    std::vector<ut64> mNodeIds;
+    QString mLabelPool;
+    std::vector<uint32_t> mLabelOffsets;
+    QString mBodyPool;
+    std::vector<uint32_t> mBodyOffsets;
+    std::vector<std::pair<ut64, ut64>> mEdges;
 };
-static_assert(std::is_move_assignable_v<GenericGraph>);
-static_assert(std::is_move_constructible_v<GenericGraph>);
 
 class GenericGraphView : public SimpleTextGraphView
 {
@@ -44,31 +113,88 @@ class GenericGraphView : public SimpleTextGraphView
 public:
     explicit GenericGraphView(QWidget *parent);
 
-    void setGraph(const GenericGraph& graph)
-    {
-        // Do not rebuild the current graph unnecessarily
-        if(graph.mId == mGraph.mId)
-            return;
-
-        mGraph = graph;
-        refreshView();
-    }
+    // Switching back to a recently shown graph restores its layout, offset and scale from the cache
+    void setGraph(GenericGraphPtr graph);
 
     void clear()
     {
-        mGraph = GenericGraph();
-        refreshView();
+        storeLayout();
+        mGraph.reset();
+        SimpleTextGraphView::refreshView();
     }
 
+    // Syntax coloring of the node bodies, without one the lines are drawn in the text color
+    using LineHighlighter = std::function<RichTextPainter::List(const QString& line, const QColor& textColor)>;
+    void setLineHighlighter(LineHighlighter highlighter);
+
+    // Show the node bodies (instructions) below the labels
+    void setShowInstructions(bool enabled);
+    bool showInstructions() const { return mShowInstructions; }
+
+public slots:
+    void refreshView() override;
+
 signals:
     void blockSelectionChanged(ut64 blockId);
 
 protected:
     void loadCurrentGraph() override;
+    void drawBlock(QPainter &p, GraphView::GraphBlock &block, bool interactive) override;
     void blockClicked(GraphView::GraphBlock &block, QMouseEvent *event, QPoint pos) override;
+    void updateLayout() override;
 
 private:
-    GenericGraph mGraph;
+    // Cropped and colored lines of a node body, computed once when the block is added
+    struct BlockInstructions
+    {
+        std::vector<RichTextPainter::List> lines;
+    };
+
+    struct CachedLayout
+    {
+        GenericGraphPtr graph;
+        std::unordered_map<ut64, GraphBlock> blocks;
+        std::unordered_map<ut64, BlockContent> blockContent;
+        std::unordered_map<ut64, BlockInstructions> blockInstructions;
+        int width = 0;
+        int height = 0;
+        QPoint offset;
+        qreal scale = 1.0;
+    };
+
+    // Last layout of a graph with the same scope and name, shared between the views to keep the
+    // picture stable when a new dump of the same function arrives
+    struct LayoutHistory
+    {
+        QHash<QString, int> lookup; // label -> index in blocks, the labels are unique
+        std::vector<GraphBlock> blocks; // entry and edge targets are indices into blocks
+        GraphView::Layout layout = GraphView::Layout::GridMedium;
+        bool horizontal = false;
+        int width = 0;
+        int height = 0;
+        bool hasView = false;
+        QPoint offset;
+        qreal scale = 1.0;
+    };
+
+    void addInstructions(ut64 id, const QString& body);
+    void storeLayout();
+    bool restoreLayout(ut64 graphId);
+    static size_t layoutCost(const CachedLayout& layout);
+
+    static LruCache<std::string, LayoutHistory>& layoutHistory();
+    std::string layoutHistoryKey() const;
+    void storeLayoutHistory(bool withView);
+    bool applyLayoutHistory(const LayoutHistory& history);
+    bool placeChangedBlocks(const LayoutHistory& history);
+    void anchorToLayoutHistory(const LayoutHistory& history);
+
+    GenericGraphPtr mGraph;
+    LruCache<ut64, CachedLayout> mLayoutCache;
+    std::unordered_map<ut64, BlockInstructions> mBlockInstructions;
+    LineHighlighter mLineHighlighter;
+    bool mShowInstructions = false;
+    QAction mActionShowInstructions;
 };
 
 namespace Ui
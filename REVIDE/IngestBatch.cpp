@@ -0,0 +1,46 @@
+#include "IngestBatch.h"
+
+#include <QJsonDocument>
+#include <QJsonObject>
+
+bool parseBatch(const QByteArray& batch, const QString& client, std::vector<BatchEntry>& entries)
+{
+    static const QByteArray magic = "REVIDE-BATCH\n";
+    if (!batch.startsWith(magic))
+        return false;
+    for (auto pos = magic.size(); pos < batch.size();)
+    {
+        auto lineEnd = batch.indexOf('\n', pos);
+        auto space = batch.indexOf(' ', pos);
+        if (lineEnd == -1 || space == -1 || space > lineEnd)
+            return false;
+        bool lengthOk = false;
+        auto length = batch.mid(pos, space - pos).toULongLong(&lengthOk);
+        auto metadata = QJsonDocument::fromJson(batch.mid(space + 1, lineEnd - space - 1)).object();
+        pos = lineEnd + 1;
+        if (!lengthOk || length > quint64(batch.size() - pos))
+            return false;
+
+        BatchEntry entry;
+        entry.type = metadata.value("type").toString();
+        if (entry.type != "module" && entry.type != "bitcode")
+            return false;
+        entry.title = metadata.value("title").toString();
+        entry.data = QByteArray::fromRawData(batch.constData() + pos, int(length));
+        entry.provenance.producer = metadata.value("producer").toString(client);
+        entry.provenance.pass = metadata.value("pass").toString();
+        entry.provenance.sequence = qint64(metadata.value("sequence").toDouble(double(entries.size())));
+        if (metadata.contains("timestamp"))
+            entry.provenance.timestamp = QDateTime::fromMSecsSinceEpoch(qint64(metadata.value("timestamp").toDouble()));
+        entries.push_back(std::move(entry));
+        pos += int(length);
+    }
+    return true;
+}
+
+void copyPayload(BatchEntry& entry)
+{
+    // The next entry follows the payload directly
+    if (entry.type != "bitcode")
+        entry.data = QByteArray(entry.data.constData(), entry.data.size());
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <vector>
+
+#include <QByteArray>
+#include <QString>
+
+#include "ModuleProvenance.h"
+
+// One module of a batch upload
+struct BatchEntry
+{
+    QString type;
+    QString title;
+    // Points into the batch, a textual module has to be copied (copyPayload) before it is parsed
+    QByteArray data;
+    ModuleProvenance provenance;
+};
+
+// REVIDE-BATCH\n followed by the entries, each <length> <metadata>\n<length bytes of payload>.
+// The metadata is a JSON object with the type (module or bitcode) and optionally the title,
+// producer, pass, sequence and timestamp (milliseconds since the epoch). Without a producer the
+// entries belong to the client address, without a sequence they keep their order in the batch.
+bool parseBatch(const QByteArray& batch, const QString& client, std::vector<BatchEntry>& entries);
+
+// Copies a textual payload out of the batch since the IR lexer reads up to a terminating '\0',
+// bitcode is left pointing into the batch
+void copyPayload(BatchEntry& entry);
@@ -0,0 +1,141 @@
+#include "IngestJournal.h"
+
+#include <QDateTime>
+#include <QMutexLocker>
+#include <QTimer>
+#include <QUrl>
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+static const QByteArray journalMagic = "REVIDE-JOURNAL\n";
+
+bool IngestJournal::open(const QString& path, QString& errorMessage)
+{
+    QMutexLocker lock(&mMutex);
+    mFile.close();
+    mFile.setFileName(path);
+    if (!mFile.open(QFile::WriteOnly | QFile::Append))
+    {
+        errorMessage = mFile.errorString();
+        return false;
+    }
+    if (mFile.size() == 0)
+        mFile.write(journalMagic);
+    return true;
+}
+
+void IngestJournal::append(const QString& type, const QString& title, const QByteArray& data)
+{
+    QMutexLocker lock(&mMutex);
+    if (!mFile.isOpen())
+        return;
+    auto header = QString("%1 %2 %3 ").arg(QDateTime::currentMSecsSinceEpoch()).arg(type).arg(data.size()).toUtf8();
+    header += QUrl::toPercentEncoding(title);
+    header += '\n';
+    mFile.write(header);
+    mFile.write(data);
+    // Keep everything up to the dump that made REVIDE crash
+    mFile.flush();
+}
+
+JournalReplay::JournalReplay(QObject* parent)
+    : QObject(parent)
+{
+}
+
+bool JournalReplay::open(const QString& path, QString& errorMessage)
+{
+    mRecords.clear();
+    mBytes = 0;
+    mFile = std::make_shared<QFile>(path);
+    if (!mFile->open(QFile::ReadOnly))
+    {
+        errorMessage = mFile->errorString();
+        return false;
+    }
+    auto size = mFile->size();
+    auto mapping = size > 0 ? mFile->map(0, size) : nullptr;
+    if (mapping == nullptr)
+    {
+        errorMessage = size > 0 ? mFile->errorString() : QString("The journal is empty");
+        return false;
+    }
+
+    // The records are sliced out of the mapping one by one, the journal itself can be larger than
+    // a QByteArray (2 GiB at most with Qt 5)
+    auto begin = reinterpret_cast<const char*>(mapping);
+    auto end = begin + size;
+    if (size < journalMagic.size() || memcmp(begin, journalMagic.constData(), size_t(journalMagic.size())) != 0)
+    {
+        errorMessage = "Not a REVIDE journal";
+        return false;
+    }
+    // The header of a record is a few numbers and the percent encoded title
+    const qint64 maxHeader = 1024 * 1024;
+    for (auto pos = begin + journalMagic.size(); pos < end;)
+    {
+        // A record cut off by a crash ends the journal
+        auto lineEnd = static_cast<const char*>(memchr(pos, '\n', size_t(std::min<qint64>(end - pos, maxHeader))));
+        if (lineEnd == nullptr && end - pos < maxHeader)
+            break;
+        auto fields = lineEnd == nullptr ? QList<QByteArray>() : QByteArray(pos, int(lineEnd - pos)).split(' ');
+        if (fields.size() != 4)
+        {
+            errorMessage = QString("Malformed record at offset %1").arg(pos - begin);
+            return false;
+        }
+        pos = lineEnd + 1;
+        auto length = fields[2].toLongLong();
+        if (length < 0 || length > end - pos)
+            break;
+#if QT_VERSION < QT_VERSION_CHECK(6, 0, 0)
+        if (length > std::numeric_limits<int>::max())
+        {
+            errorMessage = QString("The record at offset %1 is too large (2 GiB at most with Qt 5)").arg(pos - begin);
+            return false;
+        }
+#endif // QT_VERSION
+
+        Record record;
+        record.received = fields[0].toLongLong();
+        record.type = QString::fromUtf8(fields[1]);
+        record.title = QUrl::fromPercentEncoding(fields[3]);
+        record.data = QByteArray::fromRawData(pos, qsizetype(length));
+        mRecords.push_back(std::move(record));
+        mBytes += length;
+        pos += length;
+    }
+    return true;
+}
+
+void JournalReplay::start(bool originalSpeed)
+{
+    mNext = 0;
+    mOriginalSpeed = originalSpeed;
+    mTimer.start();
+    next();
+}
+
+void JournalReplay::next()
+{
+    auto first = mRecords.empty() ? 0 : mRecords.front().received;
+    while (mNext < mRecords.size())
+    {
+        const auto& record = mRecords[mNext];
+        auto due = record.received - first;
+        if (mOriginalSpeed && due > mTimer.elapsed())
+        {
+            QTimer::singleShot(int(due - mTimer.elapsed()), this, &JournalReplay::next);
+            return;
+        }
+        mNext++;
+        // A textual record runs into the header of the next one, the IR lexer needs a '\0'
+        if (record.type == "bitcode")
+            emit dump(record.type, record.title, record.data, mFile);
+        else
+            emit dump(record.type, record.title, QByteArray(record.data.constData(), record.data.size()), mFile);
+    }
+    emit finished();
+}
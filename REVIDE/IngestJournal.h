@@ -0,0 +1,67 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QMutex>
+#include <QObject>
+#include <QString>
+
+// Append-only record of the accepted dumps, to reproduce ingestion problems without the producer.
+// REVIDE-JOURNAL\n followed by the records, each
+// <milliseconds since the epoch> <type> <length> <percent encoded title>\n<length bytes of payload>
+class IngestJournal
+{
+public:
+    // Appends to an existing journal, safe to call while the webserver is running
+    bool open(const QString& path, QString& errorMessage);
+    // Called from the webserver threads, does nothing until the journal is opened
+    void append(const QString& type, const QString& title, const QByteArray& data);
+
+private:
+    QMutex mMutex;
+    QFile mFile;
+};
+
+// Feeds a journal back into the ingest pipeline, either with the original gaps between the
+// dumps or as fast as possible
+class JournalReplay : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit JournalReplay(QObject* parent = nullptr);
+    // Maps the journal and reads the headers of the records, only the textual payloads are copied
+    // (one at a time, when they are replayed)
+    bool open(const QString& path, QString& errorMessage);
+    void start(bool originalSpeed);
+
+    int size() const { return int(mRecords.size()); }
+    qint64 bytes() const { return mBytes; }
+
+signals:
+    // keepAlive holds the mapping of the journal, bitcode points into it
+    void dump(QString type, QString title, QByteArray data, std::shared_ptr<void> keepAlive);
+    void finished();
+
+private:
+    void next();
+
+    struct Record
+    {
+        qint64 received = 0;
+        QString type;
+        QString title;
+        QByteArray data;
+    };
+
+    std::shared_ptr<QFile> mFile;
+    std::vector<Record> mRecords;
+    qint64 mBytes = 0;
+    size_t mNext = 0;
+    bool mOriginalSpeed = false;
+    QElapsedTimer mTimer;
+};
@@ -0,0 +1,257 @@
+#include "IngestScheduler.h"
+#include "Metrics.h"
+
+#include <algorithm>
+#include <functional>
+
+#include <QCryptographicHash>
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QSettings>
+#include <QThread>
+
+namespace
+{
+class ParseTask : public QRunnable
+{
+public:
+    ParseTask(std::function<void()> task)
+        : mTask(std::move(task))
+    {
+    }
+
+    void run() override
+    {
+        mTask();
+    }
+
+private:
+    std::function<void()> mTask;
+};
+} // namespace
+
+IngestScheduler::IngestScheduler(QObject* parent)
+    : QObject(parent)
+{
+    // Every worker holds a complete module in memory, keep the number configurable
+    auto workers = QSettings().value("IngestWorkers", QThread::idealThreadCount()).toInt();
+    mPool.setMaxThreadCount(std::max(1, workers));
+    mLazyBitcodeBytes = QSettings().value("LazyBitcodeMB", 4).toLongLong() * 1024 * 1024;
+}
+
+IngestScheduler::~IngestScheduler()
+{
+    mPool.clear();
+    mPool.waitForDone();
+}
+
+void IngestScheduler::enqueue(const QString& type, const QString& title, const QByteArray& data, std::shared_ptr<void> keepAlive, quint64 replay)
+{
+    auto job = std::make_shared<Job>();
+    job->sequence = mNextSequence++;
+    job->type = type;
+    job->title = title;
+    job->received = QDateTime::currentDateTime();
+    job->data = data;
+    job->keepAlive = std::move(keepAlive);
+    job->replay = replay;
+    enqueue(std::move(job), &mLatestJobs);
+}
+
+void IngestScheduler::enqueueSnapshot(const QString& title, const QString& path, const QByteArray& text, int snapshot)
+{
+    auto job = std::make_shared<Job>();
+    job->sequence = mNextSequence++;
+    job->type = "module";
+    job->title = title;
+    job->path = path;
+    job->received = QDateTime::currentDateTime();
+    job->data = text;
+    job->snapshot = snapshot;
+    enqueue(std::move(job), &mLatestSnapshots);
+}
+
+void IngestScheduler::enqueueFile(const QString& title, const QString& path, const QByteArray& data, std::shared_ptr<void> keepAlive)
+{
+    auto job = std::make_shared<Job>();
+    job->sequence = mNextSequence++;
+    job->type = "module";
+    job->title = title;
+    job->path = path;
+    job->received = QDateTime::currentDateTime();
+    job->data = data;
+    job->keepAlive = std::move(keepAlive);
+    enqueue(std::move(job), nullptr);
+}
+
+void IngestScheduler::enqueueBatchEntry(const QString& type, const QString& title, const QByteArray& data, std::shared_ptr<void> keepAlive, const ModuleProvenance& provenance)
+{
+    auto job = std::make_shared<Job>();
+    job->sequence = mNextSequence++;
+    job->type = type;
+    job->title = title;
+    job->received = QDateTime::currentDateTime();
+    job->data = data;
+    job->keepAlive = std::move(keepAlive);
+    job->provenance = provenance;
+    enqueue(std::move(job), nullptr);
+}
+
+void IngestScheduler::enqueue(std::shared_ptr<Job> job, QHash<QString, std::weak_ptr<Job>>* latestJobs)
+{
+    // A burst of dumps with the same title only parses the newest one, a job that
+    // already started is parsed regardless
+    auto key = job->path.isEmpty() ? job->title : job->path;
+    if (latestJobs && !key.isEmpty())
+    {
+        if (auto previous = latestJobs->value(key).lock())
+        {
+            int expected = Job::Pending;
+            previous->state.compare_exchange_strong(expected, Job::Superseded);
+        }
+        latestJobs->insert(key, job);
+    }
+    Metrics::instance().ingestPending.add(1);
+
+    mPool.start(new ParseTask([this, job]()
+        {
+            Result result;
+            result.replay = job->replay;
+            int expected = Job::Pending;
+            if (job->state.compare_exchange_strong(expected, Job::Running))
+            {
+                result.module = parse(*job);
+                result.module->snapshot = job->snapshot;
+                result.module->provenance = job->provenance;
+                result.module->path = job->path;
+                if (result.module->outline)
+                {
+                    result.module->outlineId = job->sequence + 1;
+                    result.outlined = job;
+                }
+                else
+                {
+                    result.module->outlineId = job->outlineId;
+                }
+            }
+            else if (job->snapshot == -1)
+            {
+                // Keep the payload around for the history, favor speed over ratio
+                auto superseded = std::make_shared<SupersededDump>();
+                superseded->type = job->type;
+                superseded->title = job->title;
+                superseded->received = job->received;
+                superseded->size = job->data.size();
+                superseded->compressed = qCompress(job->data, 1);
+                result.superseded = std::move(superseded);
+            }
+
+            // Release the input (e.g. the spool file) as soon as possible
+            if (!result.outlined)
+            {
+                job->data.clear();
+                job->keepAlive.reset();
+            }
+            if (job->outlineId != 0)
+            {
+                QMetaObject::invokeMethod(this, [this, module = result.module, replay = result.replay]()
+                    {
+                        Metrics::instance().ingestPending.add(-1);
+                        emit moduleCompleted(module);
+                        if (replay != 0)
+                            emit replayDumpDone(replay);
+                    }, Qt::QueuedConnection);
+                return;
+            }
+            QMetaObject::invokeMethod(this, [this, sequence = job->sequence, result]()
+                {
+                    finished(sequence, result);
+                }, Qt::QueuedConnection);
+        }));
+}
+
+ParsedModulePtr IngestScheduler::parse(const Job& job)
+{
+    auto hash = QCryptographicHash::hash(job.data, QCryptographicHash::Sha1);
+    hash += job.type.toUtf8();
+    {
+        QMutexLocker lock(&mKnownMutex);
+        auto itr = mKnownContent.find(hash);
+        if (itr != mKnownContent.end())
+        {
+            if (auto content = itr->content.lock())
+            {
+                auto module = std::make_shared<ParsedModule>();
+                module->type = job.type;
+                module->title = job.title;
+                module->size = job.data.size();
+                module->hash = hash;
+                module->content = std::move(content);
+                module->duplicate = true;
+                module->duplicateOf = itr->title;
+                return module;
+            }
+            mKnownContent.erase(itr);
+        }
+    }
+
+    // Two identical payloads in flight at the same time are both parsed, the first
+    // one to finish is shared from then on
+    auto lazy = job.outlineId == 0 && job.snapshot == -1 && mLazyBitcodeBytes > 0 && job.data.size() >= mLazyBitcodeBytes;
+    auto module = BitcodeDialog::parse(job.type, job.title, job.data, lazy);
+    Metrics::instance().modulesParsed.add();
+    module->hash = hash;
+    // The bodies of an outline are materialized by its tab, it cannot be shared
+    if (module->content && !module->outline)
+    {
+        QMutexLocker lock(&mKnownMutex);
+        for (auto itr = mKnownContent.begin(); itr != mKnownContent.end();)
+        {
+            if (itr->content.expired())
+                itr = mKnownContent.erase(itr);
+            else
+                ++itr;
+        }
+        if (!mKnownContent.contains(hash))
+            mKnownContent.insert(hash, KnownContent{ module->content, job.title });
+    }
+    return module;
+}
+
+void IngestScheduler::finished(quint64 sequence, Result result)
+{
+    mFinished.emplace(sequence, std::move(result));
+    // The receivers might process events, take the result out before emitting
+    for (auto itr = mFinished.find(mNextReady); itr != mFinished.end(); itr = mFinished.find(mNextReady))
+    {
+        auto ready = std::move(itr->second);
+        mFinished.erase(itr);
+        mNextReady++;
+        Metrics::instance().ingestPending.add(-1);
+        // Superseded snapshot requests have neither
+        if (ready.module)
+            emit moduleReady(ready.module);
+        else if (ready.superseded)
+            emit dumpSuperseded(ready.superseded);
+        // An outline is done once its complete module is handed out
+        if (ready.replay != 0 && !ready.outlined)
+            emit replayDumpDone(ready.replay);
+
+        // The complete module is parsed after the dumps that are already waiting, it is not part
+        // of the ordered sequence
+        if (ready.outlined)
+        {
+            auto job = std::make_shared<Job>();
+            job->type = ready.outlined->type;
+            job->title = ready.outlined->title;
+            job->path = ready.outlined->path;
+            job->received = ready.outlined->received;
+            job->data = std::move(ready.outlined->data);
+            job->keepAlive = std::move(ready.outlined->keepAlive);
+            job->provenance = ready.outlined->provenance;
+            job->outlineId = ready.module->outlineId;
+            job->replay = ready.replay;
+            enqueue(std::move(job), nullptr);
+        }
+    }
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <atomic>
+#include <map>
+#include <memory>
+
+#include <QDateTime>
+#include <QHash>
+#include <QMutex>
+#include <QObject>
+#include <QThreadPool>
+
+#include "BitcodeDialog.h"
+
+// Dump that was replaced by a newer one with the same title before it was parsed
+struct SupersededDump
+{
+    QString type;
+    QString title;
+    QDateTime received;
+    qint64 size = 0;
+    QByteArray compressed; // qCompress'd payload
+};
+
+using SupersededDumpPtr = std::shared_ptr<const SupersededDump>;
+
+// Parses incoming modules on a pool of worker threads (each in its own LLVMContext)
+// and hands out the results on the GUI thread in the order they arrived. When several
+// dumps with the same title are waiting only the newest one is parsed. Payloads are hashed
+// first, an exact copy of a module that is still loaded shares its parsed content. Large
+// bitcode is handed out as an outline first (see ParsedModule::outline), the complete module
+// is parsed in the background and handed out on its own, without holding back later dumps.
+class IngestScheduler : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit IngestScheduler(QObject* parent = nullptr);
+    ~IngestScheduler();
+
+    // The data has to stay valid until it is parsed, keepAlive is released afterwards. A dump of a
+    // journal replay passes the id of the replay, replayDumpDone is emitted once it is handled
+    void enqueue(const QString& type, const QString& title, const QByteArray& data, std::shared_ptr<void> keepAlive = nullptr, quint64 replay = 0);
+    // Parses a snapshot from the history of a tab, a newer request for the same tab drops it
+    // instead of adding it to the history. The path is set for the tabs of files
+    void enqueueSnapshot(const QString& title, const QString& path, const QByteArray& text, int snapshot);
+    // File opened by the user, never superseded (files from different directories can share a title)
+    void enqueueFile(const QString& title, const QString& path, const QByteArray& data, std::shared_ptr<void> keepAlive);
+    // Module of a batch upload, never superseded since every entry stands for a step of the producer
+    void enqueueBatchEntry(const QString& type, const QString& title, const QByteArray& data, std::shared_ptr<void> keepAlive, const ModuleProvenance& provenance);
+    int pending() const { return int(mNextSequence - mNextReady); }
+
+signals:
+    void moduleReady(ParsedModulePtr module);
+    // Complete module of an outline that was handed out before, same outlineId
+    void moduleCompleted(ParsedModulePtr module);
+    void dumpSuperseded(SupersededDumpPtr dump);
+    // Emitted after the signal that hands out the (complete) module or the superseded dump
+    void replayDumpDone(quint64 replay);
+
+private:
+    struct Job
+    {
+        enum State
+        {
+            Pending,
+            Running,
+            Superseded,
+        };
+
+        quint64 sequence = 0;
+        QString type;
+        QString title;
+        QString path; // of a file
+        QDateTime received;
+        QByteArray data;
+        std::shared_ptr<void> keepAlive;
+        int snapshot = -1;
+        ModuleProvenance provenance;
+        quint64 outlineId = 0; // the complete module of an outline
+        quint64 replay = 0; // id of the journal replay, 0 for other dumps
+        std::atomic<int> state{ Pending };
+    };
+
+    struct Result
+    {
+        ParsedModulePtr module;
+        SupersededDumpPtr superseded;
+        std::shared_ptr<Job> outlined; // still holds the data for the complete module
+        quint64 replay = 0;
+    };
+
+    struct KnownContent
+    {
+        std::weak_ptr<const ModuleContent> content;
+        QString title;
+    };
+
+    // latestJobs is nullptr for jobs that cannot be superseded
+    void enqueue(std::shared_ptr<Job> job, QHash<QString, std::weak_ptr<Job>>* latestJobs);
+    void finished(quint64 sequence, Result result);
+    ParsedModulePtr parse(const Job& job);
+
+    QThreadPool mPool;
+    QMutex mKnownMutex; // the workers look up and register content concurrently
+    QHash<QByteArray, KnownContent> mKnownContent; // payload hash -> parsed content
+    QHash<QString, std::weak_ptr<Job>> mLatestJobs; // newest job per title
+    QHash<QString, std::weak_ptr<Job>> mLatestSnapshots; // newest snapshot request per title or path
+    std::map<quint64, Result> mFinished; // finished out of order, waiting for earlier jobs
+    quint64 mNextSequence = 0;
+    quint64 mNextReady = 0;
+    qint64 mLazyBitcodeBytes = 0; // bitcode of at least this size is outlined first, 0 never
+};
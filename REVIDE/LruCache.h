@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstddef>
+#include <list>
+#include <unordered_map>
+#include <utility>
+
+// Least recently used cache with a budget, the cost of every entry is provided by the caller
+template<class Key, class Value>
+class LruCache
+{
+public:
+    explicit LruCache(size_t budget = 0) : mBudget(budget) { }
+
+    size_t budget() const { return mBudget; }
+    size_t usage() const { return mUsage; }
+    size_t size() const { return mEntries.size(); }
+
+    void setBudget(size_t budget)
+    {
+        mBudget = budget;
+        evict();
+    }
+
+    // Returns nullptr if the key is not cached, otherwise marks the entry as most recently used
+    Value* find(const Key& key)
+    {
+        auto itr = mLookup.find(key);
+        if (itr == mLookup.end())
+            return nullptr;
+        mEntries.splice(mEntries.begin(), mEntries, itr->second);
+        return &itr->second->value;
+    }
+
+    // Removes the entry from the cache and moves it into value
+    bool take(const Key& key, Value& value)
+    {
+        auto itr = mLookup.find(key);
+        if (itr == mLookup.end())
+            return false;
+        value = std::move(itr->second->value);
+        mUsage -= itr->second->cost;
+        mEntries.erase(itr->second);
+        mLookup.erase(itr);
+        return true;
+    }
+
+    // Entries that are larger than the whole budget are not cached
+    void insert(const Key& key, Value value, size_t cost)
+    {
+        remove(key);
+        if (cost > mBudget)
+            return;
+        mEntries.push_front(Entry{ key, std::move(value), cost });
+        mLookup.emplace(key, mEntries.begin());
+        mUsage += cost;
+        evict();
+    }
+
+    void remove(const Key& key)
+    {
+        auto itr = mLookup.find(key);
+        if (itr == mLookup.end())
+            return;
+        mUsage -= itr->second->cost;
+        mEntries.erase(itr->second);
+        mLookup.erase(itr);
+    }
+
+    void clear()
+    {
+        mEntries.clear();
+        mLookup.clear();
+        mUsage = 0;
+    }
+
+private:
+    void evict()
+    {
+        while (mUsage > mBudget && !mEntries.empty())
+        {
+            auto& last = mEntries.back();
+            mUsage -= last.cost;
+            mLookup.erase(last.key);
+            mEntries.pop_back();
+        }
+    }
+
+    struct Entry
+    {
+        Key key;
+        Value value;
+        size_t cost = 0;
+    };
+
+    size_t mBudget = 0;
+    size_t mUsage = 0;
+    std::list<Entry> mEntries;
+    std::unordered_map<Key, typename std::list<Entry>::iterator> mLookup;
+};
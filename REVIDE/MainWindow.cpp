@@ -10,6 +10,12 @@
 #include <QFileInfo>
 #include <QDir>
 #include <QSettings>
+#include <QDebug>
+
+#include <algorithm>
+#include <limits>
+
+#include <llvm/Support/MemoryBuffer.h>
 
 MainWindow::MainWindow(int port, QWidget* parent)
     : QMainWindow(parent)
@@ -29,10 +35,26 @@ MainWindow::MainWindow(int port, QWidget* parent)
     initializeThemes();
     initializeExamples(QDir(":/examples"), ui->menu_Examples);
 
+    // Modules from the server and the command line are parsed in parallel, the tabs are
+    // created in the order the modules arrived
+    mIngestScheduler = new IngestScheduler(this);
+    connect(mIngestScheduler, &IngestScheduler::moduleReady, this, &MainWindow::llvmSlot);
+    connect(mIngestScheduler, &IngestScheduler::moduleCompleted, this, &MainWindow::completedSlot);
+    connect(mIngestScheduler, &IngestScheduler::dumpSuperseded, this, &MainWindow::supersededSlot);
+    // Emitted after the signals above, the module is shown by the time it arrives
+    connect(mIngestScheduler, &IngestScheduler::replayDumpDone, this, &MainWindow::replayProgress);
+    mHistoryBudget = QSettings().value("IngestHistoryMB", 256).toLongLong() * 1024 * 1024;
+
     // Start the server
     mWebserver = new Webserver(port, this);
     connect(mWebserver, &Webserver::hello, this, &MainWindow::helloSlot);
-    connect(mWebserver, &Webserver::llvm, this, &MainWindow::llvmSlot);
+    connect(mWebserver, &Webserver::llvm, this, [this](QString type, QString title, SpoolPtr spool) {
+        // Parsed straight from the mapped spool file, it is removed once the module is parsed
+        mIngestScheduler->enqueue(type, title, spool->data(), spool);
+    });
+    connect(mWebserver, &Webserver::llvmBatchEntry, this, [this](QString type, QString title, QByteArray data, std::shared_ptr<void> keepAlive, ModuleProvenance provenance) {
+        mIngestScheduler->enqueueBatchEntry(type, title, data, std::move(keepAlive), provenance);
+    });
     mWebserver->start();
 
     // File -> Open
@@ -57,36 +79,93 @@ MainWindow::~MainWindow()
 
 void MainWindow::loadFile(const QFileInfo& file)
 {
-    // Read the file contents
-    QByteArray contents;
+    auto extension = file.suffix();
+    if (extension != "bc" && extension != "ll")
     {
-        QFile f(file.absoluteFilePath());
-        if (!f.open(QFile::ReadOnly))
-        {
-            QMessageBox::critical(this, tr("Error"), tr("Failed to open file: \"%1\"").arg(f.fileName()));
-            return;
-        }
-        contents = f.readAll();
+        QMessageBox::critical(this, tr("Error"), tr("%1 is not a recognized file extension.").arg(extension));
+        return;
     }
 
-    // Dispatch to the right handler
-    auto extension = file.suffix();
-    if (extension == "bc" || extension == "ll")
+    // Large files are mapped instead of read and parsed straight from the mapping. The buffer is
+    // null-terminated, the textual IR parser reads the byte after the module
+    auto path = file.absoluteFilePath();
+    auto buffer = llvm::MemoryBuffer::getFile(path.toStdString(), false, true);
+    if (!buffer)
     {
-        llvmSlot("module", file.baseName(), contents);
+        QMessageBox::critical(this, tr("Error"), tr("Failed to open file: \"%1\" (%2)").arg(path, QString::fromStdString(buffer.getError().message())));
+        return;
     }
-    else
+    std::shared_ptr<llvm::MemoryBuffer> contents = std::move(*buffer);
+#if QT_VERSION < QT_VERSION_CHECK(6, 0, 0)
+    if (contents->getBufferSize() > size_t(std::numeric_limits<int>::max()))
     {
-        QMessageBox::critical(this, tr("Error"), tr("%1 is not a recognized file extension.").arg(extension));
+        QMessageBox::critical(this, tr("Error"), tr("\"%1\" is too large (2 GiB at most with Qt 5)").arg(path));
+        return;
     }
+#endif // QT_VERSION
+    auto data = QByteArray::fromRawData(contents->getBufferStart(), qsizetype(contents->getBufferSize()));
+    // The mapping is released once the module is parsed
+    mIngestScheduler->enqueueFile(file.baseName(), path, data, contents);
 }
 
 void MainWindow::noServer()
 {
     mDialogs.clear();
+    mTabsByTitle.clear();
+    mTabsByPath.clear();
+    mProducerAreas.clear();
     close();
 }
 
+void MainWindow::startJournal(const QString& path)
+{
+    QString errorMessage;
+    if (mWebserver->startJournal(path, errorMessage))
+        ui->plainTextLog->appendPlainText(QString("Journaling the dumps to %1").arg(path));
+    else
+        ui->plainTextLog->appendPlainText(QString("Failed to open the journal %1: %2").arg(path, errorMessage));
+}
+
+void MainWindow::replayJournal(const QString& path, bool originalSpeed)
+{
+    auto replay = new JournalReplay(this);
+    QString errorMessage;
+    if (!replay->open(path, errorMessage))
+    {
+        ui->plainTextLog->appendPlainText(QString("Failed to replay the journal %1: %2").arg(path, errorMessage));
+        delete replay;
+        return;
+    }
+    ui->plainTextLog->appendPlainText(QString("Replaying %1 dumps (%2 bytes) from %3").arg(replay->size()).arg(replay->bytes()).arg(path));
+
+    // Only the dumps of this replay are counted, modules from other sources can arrive in the meantime
+    auto id = ++mLastReplayId;
+    connect(replay, &JournalReplay::dump, this, [this, id](QString type, QString title, QByteArray data, std::shared_ptr<void> keepAlive) {
+        mIngestScheduler->enqueue(type, title, data, std::move(keepAlive), id);
+    });
+    connect(replay, &JournalReplay::finished, replay, &QObject::deleteLater);
+    if (replay->size() > 0)
+    {
+        auto& state = mReplays[id];
+        state.remaining = replay->size();
+        state.bytes = replay->bytes();
+        state.timer.start();
+    }
+    replay->start(originalSpeed);
+}
+
+void MainWindow::replayProgress(quint64 replay)
+{
+    auto itr = mReplays.find(replay);
+    if (itr == mReplays.end() || --itr->second.remaining > 0)
+        return;
+
+    auto seconds = std::max(itr->second.timer.nsecsElapsed() / 1e9, 1e-9);
+    auto megabytes = itr->second.bytes / (1024.0 * 1024);
+    ui->plainTextLog->appendPlainText(QString("Replay finished in %1 ms (%2 MB/s)").arg(seconds * 1000, 0, 'f', 1).arg(megabytes / seconds, 0, 'f', 1));
+    mReplays.erase(itr);
+}
+
 void MainWindow::closeEvent(QCloseEvent* event)
 {
     qtSaveGeometry(this);
@@ -101,27 +180,148 @@ void MainWindow::helloSlot(QString message)
     ui->plainTextLog->appendPlainText(message);
 }
 
-void MainWindow::llvmSlot(QString type, QString title, QByteArray data)
+void MainWindow::llvmSlot(ParsedModulePtr module)
 {
-    ui->plainTextLog->appendPlainText(QString("llvm %1 (%2), %3 bytes").arg(type).arg(title).arg(data.length()));
+    ui->plainTextLog->appendPlainText(QString("llvm %1 (%2), %3 bytes").arg(module->type).arg(module->title).arg(module->size));
+    const auto& provenance = module->provenance;
+    if (!provenance.isEmpty())
+    {
+        auto time = provenance.timestamp.isValid() ? provenance.timestamp.toString("HH:mm:ss.zzz") : QString("unknown time");
+        ui->plainTextLog->appendPlainText(QString("  from %1, #%2 after %3 at %4").arg(provenance.producer).arg(provenance.sequence).arg(provenance.pass.isEmpty() ? QString("-") : provenance.pass).arg(time));
+    }
+    if (module->outline)
+        ui->plainTextLog->appendPlainText("  outline, the function bodies are loaded in the background");
+
+    // A new version of a module that is already open updates its tab, the modules of a batch
+    // are the steps of a pipeline and all get their own tab
+    auto& tabs = module->path.isEmpty() ? mTabsByTitle : mTabsByPath;
+    auto tabKey = module->path.isEmpty() ? module->title : module->path;
+    auto existing = tabs.find(tabKey);
+    if (existing != tabs.end() && (!existing->dialog || !existing->dockWidget))
+    {
+        tabs.erase(existing);
+        existing = tabs.end();
+    }
+    if (provenance.isEmpty() && module->content && !tabKey.isEmpty() && existing != tabs.end())
+    {
+        // A pending complete module would replace this newer one
+        for (auto itr = mOutlines.begin(); itr != mOutlines.end();)
+        {
+            if (itr->dialog == existing->dialog)
+                itr = mOutlines.erase(itr);
+            else
+                ++itr;
+        }
+        QString errorMessage;
+        if (!existing->dialog->reload(*module, errorMessage))
+            ui->plainTextLog->appendPlainText(QString("Failed to load LLVM module: %1").arg(errorMessage));
+        else if (module->outline)
+            mOutlines.insert(module->outlineId, Outline{ existing->dialog, module->title });
+        else
+            mWebserver->query().publish(module->title, module->content);
+        existing->dockWidget->setAsCurrentTab();
+        return;
+    }
+
     auto bitcodeDialog = new BitcodeDialog(nullptr);
+    auto title = module->title;
+    if (!provenance.isEmpty())
+        title = QString("%1 #%2 %3").arg(provenance.producer).arg(provenance.sequence).arg(provenance.pass.isEmpty() ? module->title : provenance.pass);
+    // The query API knows the module by this title
+    auto queryTitle = title;
+    if (module->duplicate)
+    {
+        ui->plainTextLog->appendPlainText(QString("Identical to the already loaded module (%1), reusing it").arg(module->duplicateOf));
+        title = QString("%1 = %2").arg(title, module->duplicateOf);
+    }
     if (!title.isEmpty())
         bitcodeDialog->setWindowTitle(QString("[%1] %2 (%3)").arg(mDialogs.size() + 1).arg(bitcodeDialog->windowTitle()).arg(title));
     QString errorMessage;
-    if (!bitcodeDialog->load(type, data, errorMessage))
+    if (!bitcodeDialog->load(*module, errorMessage))
     {
         ui->plainTextLog->appendPlainText(QString("Failed to load LLVM module: %1").arg(errorMessage));
     }
+    else if (module->outline)
+    {
+        // Not published before it is complete, the tab materializes the bodies of the outline
+        mOutlines.insert(module->outlineId, Outline{ bitcodeDialog, queryTitle });
+    }
+    else if (!queryTitle.isEmpty())
+    {
+        mWebserver->query().publish(queryTitle, module->content);
+    }
     mDialogs.append(bitcodeDialog);
 
     auto dockWidget = new ads::CDockWidget(bitcodeDialog->windowTitle());
     dockWidget->setWidget(bitcodeDialog);
+    if (!provenance.isEmpty())
+    {
+        // One dock area per producer, the entries arrive in sequence order
+        auto& area = mProducerAreas[provenance.producer];
+        if (area)
+            mDockManager->addDockWidgetTabToArea(dockWidget, area);
+        else
+            area = mDockManager->addDockWidget(ads::RightDockWidgetArea, dockWidget);
+        return;
+    }
     mDockManager->addDockWidgetTab(ads::TopDockWidgetArea, dockWidget);
+    if (module->content && !tabKey.isEmpty())
+    {
+        tabs.insert(tabKey, Tab{ bitcodeDialog, dockWidget });
+        // A closed tab is not updated anymore, the next version opens a new one
+        connect(dockWidget, &ads::CDockWidget::closed, this, [this, dockWidget, path = module->path, tabKey]() {
+            auto& tabs = path.isEmpty() ? mTabsByTitle : mTabsByPath;
+            auto itr = tabs.find(tabKey);
+            if (itr != tabs.end() && itr->dockWidget == dockWidget)
+                tabs.erase(itr);
+        });
+        connect(bitcodeDialog, &BitcodeDialog::snapshotRequested, this, [this, title = module->title, path = module->path](const QByteArray& text, int snapshot) {
+            mIngestScheduler->enqueueSnapshot(title, path, text, snapshot);
+        });
+    }
     //bitcodeDialog->show();
     //bitcodeDialog->raise();
     //bitcodeDialog->activateWindow();
 }
 
+void MainWindow::completedSlot(ParsedModulePtr module)
+{
+    // The complete module replaces its outline in the same tab
+    auto outline = mOutlines.take(module->outlineId);
+    if (!outline.dialog)
+        return;
+    ui->plainTextLog->appendPlainText(QString("llvm %1 (%2), function bodies loaded").arg(module->type).arg(module->title));
+    QString errorMessage;
+    if (!outline.dialog->reload(*module, errorMessage))
+        ui->plainTextLog->appendPlainText(QString("Failed to load LLVM module: %1").arg(errorMessage));
+    else if (!outline.queryTitle.isEmpty())
+        mWebserver->query().publish(outline.queryTitle, module->content);
+}
+
+void MainWindow::supersededSlot(SupersededDumpPtr dump)
+{
+    ui->plainTextLog->appendPlainText(QString("llvm %1 (%2), %3 bytes superseded by a newer dump, kept in the history (%4 bytes compressed)").arg(dump->type).arg(dump->title).arg(dump->size).arg(dump->compressed.size()));
+
+    auto time = dump->received.toString("HH:mm:ss.zzz");
+    auto action = new QAction(QString("%1 (%2)").arg(dump->title, time), ui->menu_History);
+    connect(action, &QAction::triggered, [this, dump, time]() {
+        // A different title, otherwise it could be superseded by the live dumps again
+        mIngestScheduler->enqueue(dump->type, QString("%1 @ %2").arg(dump->title, time), qUncompress(dump->compressed));
+    });
+    // Newest entries on top
+    ui->menu_History->insertAction(ui->menu_History->actions().value(0), action);
+
+    mHistory.push_back({ dump, action });
+    mHistoryBytes += dump->compressed.size();
+    while (mHistoryBytes > mHistoryBudget && !mHistory.empty())
+    {
+        auto& oldest = mHistory.front();
+        mHistoryBytes -= oldest.dump->compressed.size();
+        delete oldest.action;
+        mHistory.pop_front();
+    }
+}
+
 void MainWindow::initializeThemes()
 {
     for (const auto& theme : QDir(":/themes").entryInfoList())
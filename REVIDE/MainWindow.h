@@ -1,11 +1,19 @@
 #pragma once
 
+#include <deque>
+#include <map>
+
 #include <QMainWindow>
 #include <QList>
+#include <QHash>
 #include <QDialog>
 #include <QDir>
+#include <QElapsedTimer>
+#include <QPointer>
 #include "Webserver.h"
+#include "IngestScheduler.h"
 #include "DockManager.h"
+#include "DockAreaWidget.h"
 
 QT_BEGIN_NAMESPACE
 namespace Ui
@@ -24,22 +32,67 @@ public:
 
     void loadFile(const QFileInfo& file);
     void noServer();
+    void startJournal(const QString& path);
+    // Feeds the dumps of a journal into the ingest pipeline and logs the throughput once the last
+    // one is shown
+    void replayJournal(const QString& path, bool originalSpeed);
 
 protected:
     void closeEvent(QCloseEvent* event) override;
 
 private slots:
     void helloSlot(QString message);
-    void llvmSlot(QString type, QString title, QByteArray data);
+    void llvmSlot(ParsedModulePtr module);
+    void completedSlot(ParsedModulePtr module);
+    void supersededSlot(SupersededDumpPtr dump);
 
 private:
     void addThemeFile(const QFileInfo& theme);
     void initializeThemes();
     void initializeExamples(const QDir& dir, QMenu* menu);
+    void replayProgress(quint64 replay);
 
 private:
     Ui::MainWindow* ui = nullptr;
     Webserver* mWebserver = nullptr;
+    IngestScheduler* mIngestScheduler = nullptr;
+
+    // Compressed dumps that were superseded before they were parsed (oldest first)
+    struct HistoryEntry
+    {
+        SupersededDumpPtr dump;
+        QAction* action = nullptr;
+    };
+    std::deque<HistoryEntry> mHistory;
+    qint64 mHistoryBytes = 0;
+    qint64 mHistoryBudget = 0;
+    // Journal replays with dumps that were not shown (or superseded) yet, by id
+    struct Replay
+    {
+        int remaining = 0;
+        qint64 bytes = 0;
+        QElapsedTimer timer;
+    };
+    std::map<quint64, Replay> mReplays;
+    quint64 mLastReplayId = 0;
     QList<QWidget*> mDialogs;
+    // Tabs of the successfully loaded modules, a dump with the same title (or the same file) is
+    // reloaded in place
+    struct Tab
+    {
+        QPointer<BitcodeDialog> dialog;
+        QPointer<ads::CDockWidget> dockWidget;
+    };
+    QHash<QString, Tab> mTabsByTitle;
+    QHash<QString, Tab> mTabsByPath;
+    // Tabs that show an outline, by the outlineId of the complete module that replaces it
+    struct Outline
+    {
+        QPointer<BitcodeDialog> dialog;
+        QString queryTitle;
+    };
+    QHash<quint64, Outline> mOutlines;
+    // Dock area with the tabs of every producer of batch uploads
+    QHash<QString, QPointer<ads::CDockAreaWidget>> mProducerAreas;
     ads::CDockManager* mDockManager = nullptr;
 };
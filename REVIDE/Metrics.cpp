@@ -0,0 +1,97 @@
+#include "Metrics.h"
+
+#include <QMutexLocker>
+
+void Metrics::Histogram::observe(std::chrono::nanoseconds duration)
+{
+    auto seconds = std::chrono::duration<double>(duration).count();
+    size_t bucket = 0;
+    while (bucket < bounds.size() && seconds > bounds[bucket])
+        bucket++;
+    mBuckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    mCount.fetch_add(1, std::memory_order_relaxed);
+    mSumNanoseconds.fetch_add(quint64(duration.count()), std::memory_order_relaxed);
+}
+
+Metrics& Metrics::instance()
+{
+    static Metrics metrics;
+    return metrics;
+}
+
+void Metrics::setTabMemory(const void* tab, const QString& title, qint64 bytes)
+{
+    QMutexLocker lock(&mTabsMutex);
+    auto& memory = mTabs[tab];
+    if (memory.id == 0)
+        memory.id = ++mLastTabId;
+    memory.title = title;
+    memory.bytes = bytes;
+}
+
+void Metrics::removeTab(const void* tab)
+{
+    QMutexLocker lock(&mTabsMutex);
+    mTabs.erase(tab);
+}
+
+static QByteArray escapeLabel(const QString& value)
+{
+    auto escaped = value.toUtf8();
+    escaped.replace('\\', "\\\\").replace('"', "\\\"").replace('\n', "\\n");
+    return escaped;
+}
+
+QByteArray Metrics::expose()
+{
+    QByteArray text;
+    auto header = [&text](const char* name, const char* type, const char* help) {
+        text += QByteArray("# HELP ") + name + " " + help + "\n";
+        text += QByteArray("# TYPE ") + name + " " + type + "\n";
+    };
+    auto counter = [&](const char* name, const Counter& counter, const char* help) {
+        header(name, "counter", help);
+        text += QByteArray(name) + " " + QByteArray::number(counter.value()) + "\n";
+    };
+    auto gauge = [&](const char* name, const Gauge& gauge, const char* help) {
+        header(name, "gauge", help);
+        text += QByteArray(name) + " " + QByteArray::number(gauge.value()) + "\n";
+    };
+    // The buckets are read one by one, a scrape during an update can be off by one observation
+    auto histogram = [&](const char* name, const Histogram& histogram, const char* help) {
+        header(name, "histogram", help);
+        quint64 cumulative = 0;
+        for (size_t i = 0; i < histogram.mBuckets.size(); i++)
+        {
+            cumulative += histogram.mBuckets[i].load(std::memory_order_relaxed);
+            auto le = i < Histogram::bounds.size() ? QByteArray::number(Histogram::bounds[i], 'g', 6) : QByteArray("+Inf");
+            text += QByteArray(name) + "_bucket{le=\"" + le + "\"} " + QByteArray::number(cumulative) + "\n";
+        }
+        auto sum = histogram.mSumNanoseconds.load(std::memory_order_relaxed) / 1e9;
+        text += QByteArray(name) + "_sum " + QByteArray::number(sum, 'g', 9) + "\n";
+        text += QByteArray(name) + "_count " + QByteArray::number(histogram.mCount.load(std::memory_order_relaxed)) + "\n";
+    };
+
+    counter("revide_requests_total", requests, "Requests handled by the webserver.");
+    counter("revide_failed_requests_total", failedRequests, "Requests answered with an error status.");
+    counter("revide_received_bytes_total", receivedBytes, "Bytes of the accepted request bodies.");
+    counter("revide_modules_parsed_total", modulesParsed, "Modules parsed by the ingest workers.");
+    counter("revide_modules_shown_total", modulesShown, "Modules loaded into a tab.");
+    gauge("revide_ingest_pending", ingestPending, "Modules waiting to be parsed or shown.");
+    gauge("revide_spool_pending", spoolPending, "Request bodies that were not released yet.");
+    gauge("revide_spool_bytes", spoolBytes, "Bytes of the request bodies that were not released yet.");
+    counter("revide_layout_arena_allocations_total", layoutArenaAllocations, "Allocations served by the scratch arenas of the graph layouts.");
+    counter("revide_layout_arena_upstream_bytes_total", layoutArenaUpstreamBytes, "Bytes the scratch arenas of the graph layouts requested from the heap.");
+    histogram("revide_base64_decode_seconds", base64Decode, "Decoding base64 request bodies.");
+    histogram("revide_parse_seconds", parse, "Parsing a module (LLVMGlobalContext::Parse).");
+    histogram("revide_dump_seconds", dump, "Printing a parsed module with annotations (LLVMGlobalContext::Dump).");
+    histogram("revide_set_plain_text_seconds", setPlainText, "Setting the text of the editor.");
+    histogram("revide_highlight_block_seconds", highlightBlock, "Highlighting a single line.");
+    histogram("revide_graph_layout_seconds", graphLayout, "Laying out a graph.");
+
+    header("revide_tab_memory_bytes", "gauge", "Estimated memory of the text of a tab.");
+    QMutexLocker lock(&mTabsMutex);
+    for (const auto& itr : mTabs)
+        text += "revide_tab_memory_bytes{id=\"" + QByteArray::number(itr.second.id) + "\",tab=\"" + escapeLabel(itr.second.title) + "\"} " + QByteArray::number(itr.second.bytes) + "\n";
+    return text;
+}
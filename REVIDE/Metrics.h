@@ -0,0 +1,112 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <map>
+
+#include <QByteArray>
+#include <QMutex>
+#include <QString>
+
+// Counters and latency histograms of the ingest pipeline and the UI, served by the webserver on
+// /metrics in the Prometheus text format. Updating them is lock-free (relaxed atomics), only the
+// memory of the tabs is behind a mutex since it changes when a module is loaded.
+class Metrics
+{
+public:
+    class Counter
+    {
+    public:
+        void add(quint64 value = 1) { mValue.fetch_add(value, std::memory_order_relaxed); }
+        quint64 value() const { return mValue.load(std::memory_order_relaxed); }
+
+    private:
+        std::atomic<quint64> mValue{ 0 };
+    };
+
+    class Gauge
+    {
+    public:
+        void set(qint64 value) { mValue.store(value, std::memory_order_relaxed); }
+        void add(qint64 value) { mValue.fetch_add(value, std::memory_order_relaxed); }
+        qint64 value() const { return mValue.load(std::memory_order_relaxed); }
+
+    private:
+        std::atomic<qint64> mValue{ 0 };
+    };
+
+    // Fixed buckets from 100 microseconds to 30 seconds
+    class Histogram
+    {
+    public:
+        static constexpr std::array<double, 15> bounds = { 0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 5, 30 };
+
+        void observe(std::chrono::nanoseconds duration);
+
+    private:
+        friend class Metrics;
+        std::array<std::atomic<quint64>, bounds.size() + 1> mBuckets{}; // the last one is +Inf
+        std::atomic<quint64> mCount{ 0 };
+        std::atomic<quint64> mSumNanoseconds{ 0 };
+    };
+
+    // Observes the lifetime of the scope
+    class Timer
+    {
+    public:
+        explicit Timer(Histogram& histogram)
+            : mHistogram(histogram)
+            , mStart(std::chrono::steady_clock::now())
+        {
+        }
+
+        ~Timer() { mHistogram.observe(std::chrono::steady_clock::now() - mStart); }
+
+        Timer(const Timer&) = delete;
+        Timer& operator=(const Timer&) = delete;
+
+    private:
+        Histogram& mHistogram;
+        std::chrono::steady_clock::time_point mStart;
+    };
+
+    static Metrics& instance();
+
+    Counter requests; // every request to the webserver
+    Counter failedRequests; // answered with a status >= 400
+    Counter receivedBytes; // of the accepted bodies
+    Counter modulesParsed;
+    Counter modulesShown;
+    Gauge ingestPending; // modules waiting in the IngestScheduler (or being parsed)
+    Gauge spoolPending; // spools that were not released yet
+    Gauge spoolBytes;
+    Counter layoutArenaAllocations; // served by the scratch arenas of the graph layouts
+    Counter layoutArenaUpstreamBytes; // requested from the heap by those arenas
+
+    Histogram base64Decode;
+    Histogram parse; // LLVMGlobalContext::Parse
+    Histogram dump; // LLVMGlobalContext::Dump
+    Histogram setPlainText;
+    Histogram highlightBlock;
+    Histogram graphLayout;
+
+    // Estimated memory of a tab, keyed by the dialog
+    void setTabMemory(const void* tab, const QString& title, qint64 bytes);
+    void removeTab(const void* tab);
+
+    QByteArray expose();
+
+private:
+    Metrics() = default;
+
+    struct TabMemory
+    {
+        int id = 0; // titles are not unique
+        QString title;
+        qint64 bytes = 0;
+    };
+    QMutex mTabsMutex;
+    std::map<const void*, TabMemory> mTabs;
+    int mLastTabId = 0;
+};
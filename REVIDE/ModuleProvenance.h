@@ -0,0 +1,18 @@
+#pragma once
+
+#include <QDateTime>
+#include <QMetaType>
+#include <QString>
+
+// Where a module of a batch upload came from, empty for the other modules
+struct ModuleProvenance
+{
+    QString producer; // id of the process (or harness) that dumped the module
+    QString pass; // the module was dumped after this pass
+    qint64 sequence = -1; // position in the stream of the producer
+    QDateTime timestamp;
+
+    bool isEmpty() const { return producer.isEmpty(); }
+};
+
+Q_DECLARE_METATYPE(ModuleProvenance)
@@ -0,0 +1,202 @@
+#include "ModuleQuery.h"
+#include "GraphDialog.h"
+
+#include <unordered_map>
+
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutexLocker>
+#include <QSettings>
+
+#include <llvm/IR/CFG.h>
+#include <llvm/IR/Function.h>
+
+static ModuleQuery::Response notFound(const QString& message)
+{
+    ModuleQuery::Response response;
+    response.status = 404;
+    response.body = message.toUtf8();
+    response.contentType = "text/plain";
+    return response;
+}
+
+static const ModuleContent::Segment* findFunction(const ModuleContent& content, const QString& function)
+{
+    for (const auto& segment : content.segments)
+    {
+        if (segment.function != nullptr && segment.name == function)
+            return &segment;
+    }
+    return nullptr;
+}
+
+ModuleQuery::ModuleQuery()
+    : mCache(QSettings().value("QueryCacheMB", 32).toULongLong() * 1024 * 1024)
+{
+}
+
+void ModuleQuery::publish(const QString& title, const ModuleContentPtr& content)
+{
+    QMutexLocker lock(&mMutex);
+    mModules.insert(title, Published{ content, ++mLastVersion });
+}
+
+ModuleQuery::Response ModuleQuery::modules()
+{
+    QJsonArray modules;
+    {
+        QMutexLocker lock(&mMutex);
+        for (auto itr = mModules.begin(); itr != mModules.end();)
+        {
+            if (itr->content.expired())
+            {
+                itr = mModules.erase(itr);
+                continue;
+            }
+            QJsonObject module;
+            module["title"] = itr.key();
+            module["version"] = qint64(itr->version);
+            modules.append(module);
+            ++itr;
+        }
+    }
+    Response response;
+    response.body = QJsonDocument(modules).toJson(QJsonDocument::Compact);
+    return response;
+}
+
+ModuleQuery::Response ModuleQuery::functions(const QString& title)
+{
+    return cached(title, "functions", [](const ModuleContent& content) {
+        QJsonArray functions;
+        for (const auto& segment : content.segments)
+        {
+            if (segment.function == nullptr)
+                continue;
+            QJsonObject function;
+            function["name"] = segment.name;
+            function["line"] = segment.begin + 1;
+            function["declaration"] = segment.function->isDeclaration();
+            functions.append(function);
+        }
+        Response response;
+        response.body = QJsonDocument(functions).toJson(QJsonDocument::Compact);
+        return response;
+    });
+}
+
+ModuleQuery::Response ModuleQuery::functionText(const QString& title, const QString& function)
+{
+    return cached(title, "text\n" + function.toStdString(), [&function](const ModuleContent& content) {
+        auto segment = findFunction(content, function);
+        if (segment == nullptr)
+            return notFound(QString("Function '%1' not found").arg(function));
+        Response response;
+        for (auto line = segment->begin; line < segment->end; line++)
+        {
+            response.body += content.annotatedLines[line].line.toUtf8();
+            response.body += '\n';
+        }
+        response.contentType = "text/plain";
+        return response;
+    });
+}
+
+ModuleQuery::Response ModuleQuery::cfg(const QString& title, const QString& function)
+{
+    return cached(title, "cfg\n" + function.toStdString(), [&function](const ModuleContent& content) {
+        auto segment = findFunction(content, function);
+        if (segment == nullptr)
+            return notFound(QString("Function '%1' not found").arg(function));
+
+        // Same nodes as the graph view: the blocks in text order with their instructions, the
+        // ids are the indices of the blocks
+        std::unordered_map<const llvm::BasicBlock*, ut64> blockIds;
+        std::vector<std::pair<const llvm::BasicBlock*, QString>> blocks;
+        std::vector<QString> bodies;
+        for (auto line = segment->begin; line < segment->end; line++)
+        {
+            const auto& annotatedLine = content.annotatedLines[line];
+            const auto& annotation = annotatedLine.annotation;
+            if (annotation.type == AnnotationType::BasicBlockStart)
+            {
+                auto block = static_cast<const llvm::BasicBlock*>(annotation.ptr);
+                if (!blockIds.emplace(block, blocks.size()).second)
+                    continue;
+                auto label = annotatedLine.line.split(':')[0];
+                if (block == &block->getParent()->getEntryBlock())
+                    label = "entry";
+                blocks.emplace_back(block, label);
+                bodies.emplace_back();
+            }
+            else if (annotation.type == AnnotationType::Instruction && !bodies.empty())
+            {
+                auto& body = bodies.back();
+                if (!body.isEmpty())
+                    body += '\n';
+                body += annotatedLine.line.trimmed();
+            }
+        }
+
+        GenericGraph::Builder builder(0, function);
+        for (size_t i = 0; i < blocks.size(); i++)
+        {
+            builder.addNode(i, blocks[i].second, bodies[i]);
+            for (auto successor : llvm::successors(blocks[i].first))
+            {
+                auto itr = blockIds.find(successor);
+                if (itr != blockIds.end())
+                    builder.addEdge(i, itr->second);
+            }
+        }
+        auto graph = builder.build();
+
+        QJsonArray nodes, edges;
+        for (size_t i = 0; i < graph->nodeCount(); i++)
+        {
+            QJsonObject node;
+            node["id"] = qint64(graph->nodeId(i));
+            node["label"] = graph->nodeLabel(i);
+            auto body = graph->nodeBody(i);
+            node["instructions"] = QJsonArray::fromStringList(body.isEmpty() ? QStringList() : body.split('\n'));
+            nodes.append(node);
+            for (auto to = graph->edgesBegin(i); to != graph->edgesEnd(i); ++to)
+                edges.append(QJsonArray{ qint64(graph->nodeId(i)), qint64(*to) });
+        }
+        QJsonObject cfg;
+        cfg["name"] = function;
+        cfg["nodes"] = nodes;
+        cfg["edges"] = edges;
+        Response response;
+        response.body = QJsonDocument(cfg).toJson(QJsonDocument::Compact);
+        return response;
+    });
+}
+
+ModuleQuery::Response ModuleQuery::cached(const QString& title, const std::string& query, const Serializer& serialize)
+{
+    ModuleContentPtr content;
+    std::string key;
+    {
+        QMutexLocker lock(&mMutex);
+        auto itr = mModules.find(title);
+        if (itr != mModules.end())
+            content = itr->content.lock();
+        if (!content)
+            return notFound(QString("Module '%1' not found").arg(title));
+
+        key = std::to_string(itr->version) + "\n" + query;
+        if (auto response = mCache.find(key))
+            return *response;
+    }
+
+    // Serialized without the lock, the content stays alive while it is referenced here
+    auto response = serialize(*content);
+    if (response.status == 200)
+    {
+        QMutexLocker lock(&mMutex);
+        mCache.insert(key, response, size_t(response.body.size()) + key.size());
+    }
+    return response;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <string>
+
+#include <QByteArray>
+#include <QHash>
+#include <QMutex>
+#include <QString>
+
+#include "BitcodeDialog.h"
+#include "LruCache.h"
+
+// Read-only queries over the modules shown in the tabs, answered on the webserver threads. The
+// parsed content is immutable, so the answers are built without the GUI thread. Every answer is
+// serialized once and cached per module version (a reload publishes a new version).
+class ModuleQuery
+{
+public:
+    struct Response
+    {
+        int status = 200;
+        QByteArray body;
+        const char* contentType = "application/json";
+    };
+
+    ModuleQuery();
+
+    // Called on the GUI thread when a tab shows (a new version of) a module. Only a weak
+    // reference is kept, the module disappears from the queries with its last tab
+    void publish(const QString& title, const ModuleContentPtr& content);
+
+    // The titles and versions of the published modules
+    Response modules();
+    // Name, first line and whether it is a declaration for every function
+    Response functions(const QString& title);
+    // Textual IR of a single function
+    Response functionText(const QString& title, const QString& function);
+    // Basic blocks (with their instructions) and edges of a function
+    Response cfg(const QString& title, const QString& function);
+
+private:
+    struct Published
+    {
+        std::weak_ptr<const ModuleContent> content;
+        quint64 version = 0;
+    };
+
+    using Serializer = std::function<Response(const ModuleContent& content)>;
+    Response cached(const QString& title, const std::string& query, const Serializer& serialize);
+
+    QMutex mMutex;
+    QHash<QString, Published> mModules;
+    quint64 mLastVersion = 0;
+    LruCache<std::string, Response> mCache; // version + query -> successful answer
+};
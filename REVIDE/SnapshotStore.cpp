@@ -0,0 +1,42 @@
+#include "SnapshotStore.h"
+#include "BitcodeDialog.h"
+
+int SnapshotStore::add(const ModuleContent& content, qint64 size)
+{
+    Snapshot snapshot;
+    snapshot.received = QDateTime::currentDateTime();
+    snapshot.size = size;
+    snapshot.segments.reserve(content.segments.size());
+    for (const auto& segment : content.segments)
+    {
+        snapshot.segments.push_back(segment.hash);
+        if (mTexts.contains(segment.hash))
+            continue;
+
+        QString text;
+        for (auto line = segment.begin; line < segment.end; line++)
+        {
+            if (line != segment.begin)
+                text += '\n';
+            text += content.annotatedLines[line].line;
+        }
+        // Favor speed over ratio, the history grows with every pass
+        auto compressed = qCompress(text.toUtf8(), 1);
+        mStoredBytes += compressed.size();
+        mTexts.insert(segment.hash, compressed);
+    }
+    mSnapshots.push_back(std::move(snapshot));
+    return int(mSnapshots.size()) - 1;
+}
+
+QByteArray SnapshotStore::materialize(int index) const
+{
+    QByteArray text;
+    for (const auto& hash : mSnapshots[index].segments)
+    {
+        if (!text.isEmpty())
+            text += '\n';
+        text += qUncompress(mTexts.value(hash));
+    }
+    return text;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <vector>
+
+#include <QByteArray>
+#include <QDateTime>
+#include <QHash>
+
+struct ModuleContent;
+
+// Pass-by-pass history of a module. Every snapshot is a list of segment (function) hashes,
+// the text of a segment is stored once and compressed no matter how many snapshots use it.
+class SnapshotStore
+{
+public:
+    struct Snapshot
+    {
+        QDateTime received;
+        qint64 size = 0; // of the payload
+        std::vector<QByteArray> segments; // hashes, in text order
+    };
+
+    // Returns the index of the new snapshot
+    int add(const ModuleContent& content, qint64 size);
+    // Textual IR of the snapshot, the annotations are not part of it
+    QByteArray materialize(int index) const;
+
+    int size() const { return int(mSnapshots.size()); }
+    const Snapshot& snapshot(int index) const { return mSnapshots[index]; }
+    qint64 storedBytes() const { return mStoredBytes; }
+
+private:
+    std::vector<Snapshot> mSnapshots;
+    QHash<QByteArray, QByteArray> mTexts; // segment hash -> qCompress'd text
+    qint64 mStoredBytes = 0;
+};
@@ -1,18 +1,267 @@
 #include "Webserver.h"
+#include "IngestBatch.h"
+#include "Metrics.h"
+
+#include <QDebug>
+#include <QDir>
+#include <QMutexLocker>
+#include <QRegularExpression>
+#include <QSettings>
+
+#include <algorithm>
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif // Q_OS_WIN
 
 using namespace httplib;
 
+std::shared_ptr<Spool> Spool::create(const std::shared_ptr<Quota>& quota)
+{
+    if (quota->pending.fetch_add(1) >= quota->maxPending)
+    {
+        quota->pending--;
+        return nullptr;
+    }
+    return std::shared_ptr<Spool>(new Spool(quota));
+}
+
+std::shared_ptr<void> Spool::charge(const std::shared_ptr<Quota>& quota, qint64 bytes)
+{
+    if (quota->totalBytes.fetch_add(bytes) + bytes > quota->maxTotalBytes)
+    {
+        quota->totalBytes -= bytes;
+        return nullptr;
+    }
+    // Only the deleter matters, it runs when the last reference goes away
+    return std::shared_ptr<void>(nullptr, [quota, bytes](void*) { quota->totalBytes -= bytes; });
+}
+
+Spool::Spool(std::shared_ptr<Quota> quota)
+    : mQuota(std::move(quota))
+    , mFile(QDir::temp().filePath("REVIDE-XXXXXX.spool"))
+{
+}
+
+Spool::~Spool()
+{
+    // The mapping has to be gone before the file can be removed (Windows)
+    if (mShared)
+    {
+#ifdef Q_OS_WIN
+        UnmapViewOfFile(mMapping);
+        CloseHandle(mSharedHandle);
+#else
+        munmap(mMapping, size_t(mMappedSize));
+#endif // Q_OS_WIN
+    }
+    else if (mMapping != nullptr)
+    {
+        mFile.unmap(mMapping);
+    }
+    mFile.close();
+    mFile.remove();
+    mQuota->totalBytes -= mSize;
+    mQuota->pending--;
+}
+
+Spool::WriteResult Spool::write(const char* data, size_t length)
+{
+    auto size = mSize + qint64(length);
+    if (size > mQuota->maxRequestBytes)
+        return WriteResult::RequestTooLarge;
+    if (mQuota->totalBytes.fetch_add(qint64(length)) + qint64(length) > mQuota->maxTotalBytes)
+    {
+        mQuota->totalBytes -= qint64(length);
+        return WriteResult::QuotaExceeded;
+    }
+    mSize = size;
+    if (mFile.write(data, qint64(length)) != qint64(length))
+        return WriteResult::IoError;
+    return WriteResult::Ok;
+}
+
+bool Spool::map()
+{
+    // The textual IR parser reads the byte after the module, a terminator keeps it in the mapping
+    if (mFile.write("\0", 1) != 1 || !mFile.flush())
+        return false;
+    if (mSize == 0)
+        return true;
+    mMapping = mFile.map(0, mSize + 1, QFileDevice::MapPrivateOption);
+    return mMapping != nullptr;
+}
+
+Spool::WriteResult Spool::mapShared(const QString& name, qint64 size)
+{
+    // Names created by REVIDE::Dump (REVIDE-<pid>-<counter>), nothing else is opened
+    static const QRegularExpression validName("^REVIDE-[0-9]+-[0-9]+$");
+    if (!validName.match(name).hasMatch() || size <= 0)
+        return WriteResult::IoError;
+    if (size > mQuota->maxRequestBytes)
+        return WriteResult::RequestTooLarge;
+
+#ifdef Q_OS_WIN
+    auto handle = OpenFileMappingW(FILE_MAP_READ, FALSE, QString("Local\\%1").arg(name).toStdWString().c_str());
+    if (handle == nullptr)
+        return WriteResult::IoError;
+    // Fails when the mapping is smaller than size. REVIDE::Dump adds a terminator after the body
+    // (see Spool::map), clients that do not are mapped without it
+    auto mapping = MapViewOfFile(handle, FILE_MAP_READ, 0, 0, SIZE_T(size + 1));
+    if (mapping == nullptr)
+        mapping = MapViewOfFile(handle, FILE_MAP_READ, 0, 0, SIZE_T(size));
+    if (mapping == nullptr)
+    {
+        CloseHandle(handle);
+        return WriteResult::IoError;
+    }
+#else
+    auto path = QString("/%1").arg(name).toUtf8();
+    auto fd = shm_open(path.constData(), O_RDONLY, 0);
+    if (fd == -1)
+        return WriteResult::IoError;
+    // Reading past the end of the object would be a SIGBUS. REVIDE::Dump adds a terminator after
+    // the body (see Spool::map), clients that do not are mapped without it
+    struct stat st;
+    void* mapping = MAP_FAILED;
+    qint64 mappedSize = 0;
+    if (fstat(fd, &st) == 0 && st.st_size >= size)
+    {
+        mappedSize = st.st_size > size ? size + 1 : size;
+        mapping = mmap(nullptr, size_t(mappedSize), PROT_READ, MAP_SHARED, fd, 0);
+    }
+    ::close(fd);
+    if (mapping == MAP_FAILED)
+        return WriteResult::IoError;
+    // The mapping keeps the memory alive, the name is not needed anymore
+    shm_unlink(path.constData());
+#endif // Q_OS_WIN
+
+    if (mQuota->totalBytes.fetch_add(size) + size > mQuota->maxTotalBytes)
+    {
+        mQuota->totalBytes -= size;
+#ifdef Q_OS_WIN
+        UnmapViewOfFile(mapping);
+        CloseHandle(handle);
+#else
+        munmap(mapping, size_t(mappedSize));
+#endif // Q_OS_WIN
+        return WriteResult::QuotaExceeded;
+    }
+    mShared = true;
+    mMapping = reinterpret_cast<uchar*>(mapping);
+    mSize = size;
+#ifdef Q_OS_WIN
+    mSharedHandle = handle;
+#else
+    mMappedSize = mappedSize;
+#endif // Q_OS_WIN
+    return WriteResult::Ok;
+}
+
+void Spool::decodeBase64()
+{
+    Metrics::Timer timer(Metrics::instance().base64Decode);
+    mDecoded = QByteArray::fromBase64(data());
+}
+
+void Spool::replace(const QByteArray& data)
+{
+    mDecoded = data;
+}
+
+QByteArray Spool::data() const
+{
+    if (!mDecoded.isNull())
+        return mDecoded;
+    if (mMapping == nullptr)
+        return QByteArray();
+    return QByteArray::fromRawData(reinterpret_cast<const char*>(mMapping), int(mSize));
+}
+
 Webserver::Webserver(int port, QObject* parent)
     : QThread(parent)
     , mPort(port)
+    , mQuota(std::make_shared<Spool::Quota>())
 {
+    qRegisterMetaType<SpoolPtr>("SpoolPtr");
+    qRegisterMetaType<std::shared_ptr<void>>("std::shared_ptr<void>");
+    qRegisterMetaType<ModuleProvenance>("ModuleProvenance");
+
+    // Limits for the bodies that are spooled to disk while they wait to be parsed
+    QSettings settings;
+    mQuota->maxRequestBytes = settings.value("IngestMaxRequestMB", 1024).toLongLong() * 1024 * 1024;
+    mQuota->maxTotalBytes = settings.value("IngestMaxTotalMB", 4096).toLongLong() * 1024 * 1024;
+    mQuota->maxPending = settings.value("IngestMaxPending", 8).toInt();
+    mRetryAfterSeconds = settings.value("IngestRetryAfterSeconds", 2).toInt();
+    mDeltaBases.setBudget(settings.value("DeltaBasesMB", 256).toULongLong() * 1024 * 1024);
+    auto journal = settings.value("IngestJournal").toString();
+    QString journalError;
+    if (!journal.isEmpty() && !mJournal.open(journal, journalError))
+        qWarning() << "Failed to open the ingest journal" << journal << journalError;
+
     mServer = new Server();
+    // Requests with a larger Content-Length are answered with 413 before reading the body
+    mServer->set_payload_max_length(size_t(mQuota->maxRequestBytes));
+    // REVIDE::Dump keeps its connection alive, do not make it reconnect every few modules
+    mServer->set_keep_alive_max_count(1000);
+
+    mServer->set_logger([](const Request& req, const Response& res) {
+        auto& metrics = Metrics::instance();
+        metrics.requests.add();
+        if (res.status >= 400)
+            metrics.failedRequests.add();
+    });
+
+    // Text exposition format (Prometheus) for a local scraper
+    mServer->Get("/metrics", [this](const Request& req, Response& res) {
+        auto& metrics = Metrics::instance();
+        metrics.spoolPending.set(mQuota->pending);
+        metrics.spoolBytes.set(mQuota->totalBytes);
+        auto text = metrics.expose();
+        res.set_content(text.constData(), size_t(text.size()), "text/plain; version=0.0.4");
+    });
+
+    // Read-only queries over the modules in the tabs, answered on the server threads:
+    // /modules, /module/functions?title=, /module/function?title=&name= (textual IR) and
+    // /module/cfg?title=&name= (JSON)
+    auto reply = [](Response& res, const ModuleQuery::Response& response) {
+        res.status = response.status;
+        res.set_content(response.body.constData(), size_t(response.body.size()), response.contentType);
+    };
+    auto param = [](const Request& req, const char* name) {
+        return QString::fromStdString(req.get_param_value(name));
+    };
+    mServer->Get("/modules", [this, reply](const Request& req, Response& res) {
+        reply(res, mQuery.modules());
+    });
+    mServer->Get("/module/functions", [this, reply, param](const Request& req, Response& res) {
+        reply(res, mQuery.functions(param(req, "title")));
+    });
+    mServer->Get("/module/function", [this, reply, param](const Request& req, Response& res) {
+        reply(res, mQuery.functionText(param(req, "title"), param(req, "name")));
+    });
+    mServer->Get("/module/cfg", [this, reply, param](const Request& req, Response& res) {
+        reply(res, mQuery.cfg(param(req, "title"), param(req, "name")));
+    });
 
     mServer->Get("/hi", [this](const Request& req, Response& res) {
         emit hello(tr("Hello from %1").arg(QString::fromStdString(req.remote_addr)));
     });
 
-    mServer->Post("/llvm", [this](const Request& req, Response& res) {
+    // The body is either raw (Content-Type: application/octet-stream) or base64 (legacy clients).
+    // A gzip/deflate Content-Encoding is decompressed by httplib while the body is received.
+    // Chunked uploads are supported, the body is streamed into a spool file either way.
+    // Clients on this machine can pass a shared memory object instead of the body
+    // (X-REVIDE-Shared-Memory and X-REVIDE-Shared-Size), it is answered with 404 if it is missing.
+    // A delta (type=delta) is turned into the full textual module before it is parsed, the bases
+    // are kept per producer (an id unique to the client process) and title.
+    mServer->Post("/llvm", [this](const Request& req, Response& res, const ContentReader& contentReader) {
         QString type, title;
         if (!req.has_param("type"))
         {
@@ -24,10 +273,78 @@ Webserver::Webserver(int port, QObject* parent)
         if (req.has_param("title"))
             title = QString::fromStdString(req.get_param_value("title"));
 
-        auto body = QByteArray::fromStdString(req.body);
-        body = QByteArray::fromBase64(body);
+        auto spool = receive(req, res, contentReader);
+        if (!spool)
+            return;
+
+        if (type == "delta")
+        {
+            QByteArray module;
+            auto producer = QString::fromStdString(req.get_param_value("producer"));
+            switch (applyDelta(producer, title, spool->data(), module))
+            {
+            case DeltaResult::Ok:
+                break;
+            case DeltaResult::Malformed:
+                res.status = 400;
+                res.set_content("Malformed delta", "text/plain");
+                return;
+            case DeltaResult::UnknownBase:
+                res.status = 409;
+                res.set_content("Unknown delta base, send the full module", "text/plain");
+                return;
+            }
+            spool->replace(module);
+            type = "module";
+        }
+
+        // Journaled as the full module, the replay does not depend on earlier dumps
+        mJournal.append(type, title, spool->data());
+        emit llvm(type, title, spool);
+    });
 
-        emit llvm(type, title, body);
+    // Many modules with their provenance in one request, see parseBatch for the format. The
+    // modules are parsed in parallel and shown grouped by producer, in sequence order.
+    mServer->Post("/llvm/batch", [this](const Request& req, Response& res, const ContentReader& contentReader) {
+        auto spool = receive(req, res, contentReader);
+        if (!spool)
+            return;
+
+        std::vector<BatchEntry> entries;
+        if (!parseBatch(spool->data(), QString::fromStdString(req.remote_addr), entries))
+        {
+            res.status = 400;
+            res.set_content("Malformed batch", "text/plain");
+            return;
+        }
+        std::stable_sort(entries.begin(), entries.end(), [](const BatchEntry& a, const BatchEntry& b) {
+            if (a.provenance.producer != b.provenance.producer)
+                return a.provenance.producer < b.provenance.producer;
+            return a.provenance.sequence < b.provenance.sequence;
+        });
+        // Bitcode entries point into the spool, it goes away once the last one is parsed. The
+        // copies of the textual entries count toward the quota until they are parsed, the batch
+        // is refused when they do not fit.
+        std::vector<std::shared_ptr<void>> keepAlive;
+        keepAlive.reserve(entries.size());
+        for (auto& entry : entries)
+        {
+            if (entry.type == "bitcode")
+            {
+                keepAlive.push_back(spool);
+                continue;
+            }
+            auto charge = Spool::charge(mQuota, entry.data.size());
+            if (!charge)
+            {
+                retryLater(res, "Too much data is waiting to be parsed");
+                return;
+            }
+            copyPayload(entry);
+            keepAlive.push_back(std::move(charge));
+        }
+        for (size_t i = 0; i < entries.size(); i++)
+            emit llvmBatchEntry(entries[i].type, entries[i].title, entries[i].data, std::move(keepAlive[i]), entries[i].provenance);
     });
 
     // TODO: VTIL symbolic expression
@@ -53,3 +370,177 @@ void Webserver::close()
     while (mServer->is_running())
         QThread::msleep(10);
 }
+
+SpoolPtr Webserver::receive(const Request& req, Response& res, const ContentReader& contentReader)
+{
+    auto encoding = req.get_header_value("Content-Encoding");
+    auto compressed = !encoding.empty() && encoding != "identity";
+#ifndef CPPHTTPLIB_ZLIB_SUPPORT
+    if (compressed)
+    {
+        res.status = 415;
+        res.set_content("Compressed bodies are not supported (built without zlib)", "text/plain");
+        return nullptr;
+    }
+#endif // CPPHTTPLIB_ZLIB_SUPPORT
+
+    auto spool = Spool::create(mQuota);
+    if (!spool)
+    {
+        retryLater(res, "Too many modules are waiting to be parsed");
+        return nullptr;
+    }
+
+    auto sharedMemory = req.get_header_value("X-REVIDE-Shared-Memory");
+    if (!sharedMemory.empty())
+    {
+        auto size = QString::fromStdString(req.get_header_value("X-REVIDE-Shared-Size")).toLongLong();
+        switch (spool->mapShared(QString::fromStdString(sharedMemory), size))
+        {
+        case Spool::WriteResult::Ok:
+            break;
+        case Spool::WriteResult::RequestTooLarge:
+            res.status = 413;
+            res.set_content("Request body is too large", "text/plain");
+            return nullptr;
+        case Spool::WriteResult::QuotaExceeded:
+            retryLater(res, "Too much data is waiting to be parsed");
+            return nullptr;
+        case Spool::WriteResult::IoError:
+            res.status = 404;
+            res.set_content("Shared memory object not found", "text/plain");
+            return nullptr;
+        }
+    }
+    else
+    {
+        if (!spool->open())
+        {
+            res.status = 507;
+            res.set_content("Failed to create the spool file", "text/plain");
+            return nullptr;
+        }
+
+        auto writeResult = Spool::WriteResult::Ok;
+        auto received = contentReader([&spool, &writeResult](const char* data, size_t length) {
+            writeResult = spool->write(data, length);
+            return writeResult == Spool::WriteResult::Ok;
+        });
+        switch (writeResult)
+        {
+        case Spool::WriteResult::Ok:
+            break;
+        case Spool::WriteResult::RequestTooLarge:
+            res.status = 413;
+            res.set_content("Request body is too large", "text/plain");
+            return nullptr;
+        case Spool::WriteResult::QuotaExceeded:
+            retryLater(res, "Too much data is waiting to be parsed");
+            return nullptr;
+        case Spool::WriteResult::IoError:
+            res.status = 507;
+            res.set_content("Failed to write the spool file", "text/plain");
+            return nullptr;
+        }
+        if (!received)
+        {
+            // The status is set by httplib when decompression fails or the body is too large
+            if (res.status < 400)
+                res.status = 400;
+            return nullptr;
+        }
+
+        if (!spool->map())
+        {
+            res.status = 500;
+            res.set_content("Failed to map the spool file", "text/plain");
+            return nullptr;
+        }
+        if (req.get_header_value("Content-Type").rfind("application/octet-stream", 0) != 0)
+            spool->decodeBase64();
+    }
+    Metrics::instance().receivedBytes.add(quint64(spool->size()));
+    return spool;
+}
+
+// REVIDE-DELTA <id> <base>\n followed by the segments of the module in order, either
+// R <index> <count>\n (segments of the base) or T <length>\n<text>. Base 0 is the full module.
+Webserver::DeltaResult Webserver::applyDelta(const QString& producer, const QString& title, const QByteArray& delta, QByteArray& module)
+{
+    auto headerEnd = delta.indexOf('\n');
+    if (headerEnd == -1)
+        return DeltaResult::Malformed;
+    auto header = delta.left(headerEnd).split(' ');
+    if (header.size() != 3 || header[0] != "REVIDE-DELTA")
+        return DeltaResult::Malformed;
+    bool idOk = false, baseOk = false;
+    auto id = header[1].toULongLong(&idOk);
+    auto base = header[2].toULongLong(&baseOk);
+    if (!idOk || !baseOk)
+        return DeltaResult::Malformed;
+
+    auto key = (producer + '\n' + title).toStdString();
+    QMutexLocker lock(&mDeltaMutex);
+    const DeltaBase* previous = nullptr;
+    if (base != 0)
+    {
+        previous = mDeltaBases.find(key);
+        if (previous == nullptr || previous->id != base)
+            return DeltaResult::UnknownBase;
+    }
+
+    std::vector<QByteArray> segments;
+    qint64 size = 0;
+    for (auto pos = headerEnd + 1; pos < delta.size();)
+    {
+        auto lineEnd = delta.indexOf('\n', pos);
+        if (lineEnd == -1 || lineEnd - pos < 3 || delta[pos + 1] != ' ')
+            return DeltaResult::Malformed;
+        auto values = delta.mid(pos + 2, lineEnd - pos - 2).split(' ');
+        auto kind = delta[pos];
+        pos = lineEnd + 1;
+        if (kind == 'R' && values.size() == 2)
+        {
+            bool indexOk = false, countOk = false;
+            auto index = values[0].toULongLong(&indexOk);
+            auto count = values[1].toULongLong(&countOk);
+            if (!indexOk || !countOk || previous == nullptr || index > previous->segments.size() || count > previous->segments.size() - index)
+                return DeltaResult::Malformed;
+            for (auto i = index; i < index + count; i++)
+            {
+                segments.push_back(previous->segments[i]);
+                size += segments.back().size();
+            }
+        }
+        else if (kind == 'T' && values.size() == 1)
+        {
+            bool lengthOk = false;
+            auto length = values[0].toULongLong(&lengthOk);
+            if (!lengthOk || length > quint64(delta.size() - pos))
+                return DeltaResult::Malformed;
+            // Deep copy, the delta points into the spool file
+            segments.push_back(QByteArray(delta.constData() + pos, int(length)));
+            size += segments.back().size();
+            pos += int(length);
+        }
+        else
+        {
+            return DeltaResult::Malformed;
+        }
+    }
+
+    module.clear();
+    module.reserve(int(size));
+    for (const auto& segment : segments)
+        module += segment;
+    auto cost = size_t(size) + segments.size() * sizeof(QByteArray) + key.size();
+    mDeltaBases.insert(key, DeltaBase{ id, std::move(segments) }, cost);
+    return DeltaResult::Ok;
+}
+
+void Webserver::retryLater(Response& res, const char* reason)
+{
+    res.status = 503;
+    res.set_header("Retry-After", std::to_string(mRetryAfterSeconds).c_str());
+    res.set_content(reason, "text/plain");
+}
@@ -1,8 +1,84 @@
 #pragma once
 
 #include <QThread>
+#include <QTemporaryFile>
+#include <QMetaType>
+#include <QMutex>
+#include <atomic>
 #include <memory>
+#include <vector>
 #include "httplib.h"
+#include "ModuleProvenance.h"
+#include "IngestJournal.h"
+#include "ModuleQuery.h"
+#include "LruCache.h"
+
+// Request body spooled to a temporary file and mapped into memory for parsing. The file is
+// removed and its size returned to the ingest quota when the last reference goes away.
+// Clients on the same machine can hand over a shared memory object instead (mapShared).
+class Spool
+{
+public:
+    // Limits shared by all the spools of a webserver, they outlive the webserver itself
+    struct Quota
+    {
+        qint64 maxRequestBytes = 0;
+        qint64 maxTotalBytes = 0;
+        int maxPending = 0;
+        std::atomic<qint64> totalBytes{ 0 };
+        std::atomic<int> pending{ 0 };
+    };
+
+    enum class WriteResult
+    {
+        Ok,
+        RequestTooLarge,
+        QuotaExceeded,
+        IoError,
+    };
+
+    // Returns nullptr when the maximum number of pending spools is reached
+    static std::shared_ptr<Spool> create(const std::shared_ptr<Quota>& quota);
+    // Charges a copy of spooled data (e.g. a textual batch entry) to the quota until the returned
+    // object goes away, nullptr when the copy does not fit
+    static std::shared_ptr<void> charge(const std::shared_ptr<Quota>& quota, qint64 bytes);
+    ~Spool();
+
+    Spool(const Spool&) = delete;
+    Spool& operator=(const Spool&) = delete;
+
+    bool open() { return mFile.open(); }
+    WriteResult write(const char* data, size_t length);
+    // Finish writing and map the file into memory
+    bool map();
+    // Map the shared memory object a client wrote the body to instead of receiving it, IoError
+    // means the object does not exist (or is smaller than size)
+    WriteResult mapShared(const QString& name, qint64 size);
+    // Replace the contents with the base64 decoded body (legacy clients)
+    void decodeBase64();
+    // Replace the contents with data that was derived from the body (e.g. a delta)
+    void replace(const QByteArray& data);
+
+    qint64 size() const { return mSize; }
+    // Points into the mapping (no copy), only valid while the spool is alive
+    QByteArray data() const;
+
+private:
+    explicit Spool(std::shared_ptr<Quota> quota);
+
+    std::shared_ptr<Quota> mQuota;
+    QTemporaryFile mFile;
+    uchar* mMapping = nullptr;
+    bool mShared = false; // mMapping is a shared memory object
+    void* mSharedHandle = nullptr; // of the file mapping (Windows)
+    qint64 mMappedSize = 0; // of the shared memory object, with the terminator if there is one
+    qint64 mSize = 0;
+    QByteArray mDecoded;
+};
+
+using SpoolPtr = std::shared_ptr<Spool>;
+Q_DECLARE_METATYPE(SpoolPtr)
+Q_DECLARE_METATYPE(std::shared_ptr<void>)
 
 class Webserver : public QThread
 {
@@ -12,12 +88,48 @@ public:
     ~Webserver();
     void run() override;
     void close();
+    // Append every accepted dump to a journal (see IngestJournal)
+    bool startJournal(const QString& path, QString& errorMessage) { return mJournal.open(path, errorMessage); }
+    // Modules answered by the query endpoints
+    ModuleQuery& query() { return mQuery; }
 
 signals:
     void hello(QString ip);
-    void llvm(QString type, QString title, QByteArray data);
+    void llvm(QString type, QString title, SpoolPtr data);
+    // One module of a batch upload, bitcode points into the spool of the whole batch (keepAlive)
+    // and a textual module is a copy that keepAlive charges to the ingest quota
+    void llvmBatchEntry(QString type, QString title, QByteArray data, std::shared_ptr<void> keepAlive, ModuleProvenance provenance);
 
 private:
+    // Spools the body of the request (or maps the shared memory object it names), nullptr when
+    // the request was already answered with an error
+    SpoolPtr receive(const httplib::Request& req, httplib::Response& res, const httplib::ContentReader& contentReader);
+    void retryLater(httplib::Response& res, const char* reason);
+
+    enum class DeltaResult
+    {
+        Ok,
+        Malformed,
+        UnknownBase, // the client has to send the full module
+    };
+
+    // Reconstructs the module from a delta against the last module of the producer with the same title
+    DeltaResult applyDelta(const QString& producer, const QString& title, const QByteArray& delta, QByteArray& module);
+
     httplib::Server* mServer;
     int mPort;
+    std::shared_ptr<Spool::Quota> mQuota;
+    int mRetryAfterSeconds = 0;
+
+    // Last module of every producer and title that was sent as a delta, split the way the
+    // client split it. A base that was evicted is answered with UnknownBase.
+    struct DeltaBase
+    {
+        quint64 id = 0;
+        std::vector<QByteArray> segments;
+    };
+    QMutex mDeltaMutex;
+    LruCache<std::string, DeltaBase> mDeltaBases; // producer + title -> base
+    IngestJournal mJournal;
+    ModuleQuery mQuery;
 };
@@ -6,6 +6,9 @@
 #include <QObject>
 #include <QFont>
 #include <QFontMetrics>
+#include <QHash>
+
+#include <memory>
 
 template<typename T>
 class CachedFontMetrics
@@ -17,6 +20,22 @@ public:
         mHeight = mFontMetrics.height();
     }
 
+    /**
+     * @brief Get the instance shared by all the users of the font.
+     * The width table is large, widgets using the same font shouldn't each fill their own copy.
+     */
+    static std::shared_ptr<CachedFontMetrics> shared(const QFont &font)
+    {
+        static QHash<QString, std::weak_ptr<CachedFontMetrics>> instances;
+        auto key = font.key();
+        auto instance = instances.value(key).lock();
+        if (!instance) {
+            instance = std::make_shared<CachedFontMetrics>(font);
+            instances.insert(key, instance);
+        }
+        return instance;
+    }
+
     T width(const QChar &ch)
     {
         // return mFontMetrics.width(ch);
@@ -2,6 +2,7 @@
 #define LINKED_LIST_POOL_H
 
 #include <vector>
+#include <memory_resource>
 #include <cstdint>
 #include <iterator>
 
@@ -13,7 +14,7 @@
  *
  * In contrast to std::list and std::forward_list doesn't allocate each node separately.
  * LinkedListPool can reserve all the memory for multiple lists during construction. Uses
- * std::vector as backing container.
+ * std::pmr::vector as backing container, the memory can be drawn from a scratch arena.
  */
 template<class T>
 class LinkedListPool
@@ -94,8 +95,11 @@ public:
     /**
      * @brief Create a linked list pool with capacity for \a initialCapacity list items.
      * @param initialCapacity number of elements to preallocate.
+     * @param resource memory resource used for the items
      */
-    LinkedListPool(size_t initialCapacity) : data(1)
+    LinkedListPool(size_t initialCapacity,
+                   std::pmr::memory_resource *resource = std::pmr::get_default_resource())
+        : data(1, resource)
     {
         data.reserve(initialCapacity + 1); // [0] element reserved
     }
@@ -179,7 +183,7 @@ public:
 private:
     ListIterator iteratorFromIndex(IndexType index) { return ListIterator { index, this }; }
 
-    std::vector<Item> data;
+    std::pmr::vector<Item> data;
 };
 
 #endif // LINKED_LIST_POOL
@@ -0,0 +1,123 @@
+#ifndef SCRATCH_ARENA_H
+#define SCRATCH_ARENA_H
+
+#include <memory_resource>
+#include <memory>
+#include <algorithm>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief Resettable bump allocator for temporary data of algorithms that run repeatedly.
+ *
+ * Deallocation is a no-op, all the memory is reclaimed at once by reset(). In contrast to
+ * std::pmr::monotonic_buffer_resource the memory isn't returned to the upstream resource on reset,
+ * instead the chunks used by the previous run are merged into a single chunk that is reused by the
+ * next run. After a few runs of similar size no upstream allocations are necessary.
+ */
+class ScratchArena : public std::pmr::memory_resource
+{
+public:
+    struct Stats
+    {
+        size_t allocations = 0; //!< allocations served since the last reset
+        size_t bytes = 0; //!< bytes served since the last reset
+        size_t upstreamAllocations = 0; //!< chunks requested from upstream since the last reset
+        size_t upstreamBytes = 0; //!< bytes requested from upstream since the last reset
+        size_t capacity = 0; //!< total size of the chunks owned by the arena
+    };
+
+    explicit ScratchArena(size_t initialSize = 64 * 1024,
+                          std::pmr::memory_resource *upstream = std::pmr::new_delete_resource())
+        : upstream(upstream), nextChunkSize(initialSize)
+    {
+    }
+    ScratchArena(const ScratchArena &) = delete;
+    ScratchArena &operator=(const ScratchArena &) = delete;
+    ~ScratchArena() override { releaseChunks(); }
+
+    /**
+     * @brief Reclaim all the memory handed out so far. Invalidates all the allocations.
+     */
+    void reset()
+    {
+        if (chunks.size() > 1) {
+            // Coalesce the chunks so the next run of the same size fits into one
+            size_t total = stats.capacity;
+            releaseChunks();
+            addChunk(total);
+        }
+        if (!chunks.empty()) {
+            current = static_cast<char *>(chunks.front().data);
+            end = current + chunks.front().size;
+        }
+        size_t capacity = stats.capacity;
+        stats = Stats();
+        stats.capacity = capacity;
+    }
+
+    const Stats &getStats() const { return stats; }
+
+protected:
+    void *do_allocate(size_t bytes, size_t alignment) override
+    {
+        stats.allocations++;
+        stats.bytes += bytes;
+        auto space = static_cast<size_t>(end - current);
+        void *ptr = current;
+        if (!current || !std::align(alignment, bytes, ptr, space)) {
+            addChunk(std::max(bytes + alignment, nextChunkSize));
+            ptr = current;
+            space = static_cast<size_t>(end - current);
+            std::align(alignment, bytes, ptr, space);
+        }
+        current = static_cast<char *>(ptr) + bytes;
+        return ptr;
+    }
+
+    void do_deallocate(void *, size_t, size_t) override {}
+
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override
+    {
+        return this == &other;
+    }
+
+private:
+    struct Chunk
+    {
+        void *data;
+        size_t size;
+    };
+
+    void addChunk(size_t size)
+    {
+        auto data = upstream->allocate(size, alignof(std::max_align_t));
+        chunks.push_back({ data, size });
+        current = static_cast<char *>(data);
+        end = current + size;
+        stats.upstreamAllocations++;
+        stats.upstreamBytes += size;
+        stats.capacity += size;
+        nextChunkSize = std::max(nextChunkSize, size * 2);
+    }
+
+    void releaseChunks()
+    {
+        for (auto &chunk : chunks) {
+            upstream->deallocate(chunk.data, chunk.size, alignof(std::max_align_t));
+        }
+        chunks.clear();
+        current = end = nullptr;
+        stats.capacity = 0;
+    }
+
+    std::pmr::memory_resource *upstream;
+    std::vector<Chunk> chunks;
+    char *current = nullptr;
+    char *end = nullptr;
+    size_t nextChunkSize;
+    Stats stats;
+};
+
+#endif // SCRATCH_ARENA_H
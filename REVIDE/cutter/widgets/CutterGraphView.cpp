@@ -109,7 +109,7 @@ void CutterGraphView::initFont()
     padding = ACharWidth;
     charHeight = static_cast<int>(metrics.height());
     charOffset = 0;
-    mFontMetrics.reset(new CachedFontMetrics<qreal>(font()));
+    mFontMetrics = CachedFontMetrics<qreal>::shared(font());
 }
 
 void CutterGraphView::zoom(QPointF mouseRelativePos, double velocity)
@@ -124,7 +124,7 @@ protected:
     virtual void updateLayout();
 
     // Font data
-    std::unique_ptr<CachedFontMetrics<qreal>> mFontMetrics;
+    std::shared_ptr<CachedFontMetrics<qreal>> mFontMetrics;
     qreal ACharWidth; // width of character A
     int charHeight;
     int charOffset;
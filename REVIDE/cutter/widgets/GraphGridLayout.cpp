@@ -7,8 +7,11 @@
 #include <cassert>
 #include <queue>
 #include <map>
+#include <deque>
+#include <numeric>
 
 #include "common/BinaryTrees.h"
+#include "Metrics.h"
 
 /** @class GraphGridLayout
 
@@ -198,18 +201,21 @@ GraphGridLayout::GraphGridLayout(GraphGridLayout::LayoutType layoutType) : Graph
     }
 }
 
-std::vector<ut64> GraphGridLayout::topoSort(LayoutState &state, ut64 entry)
+std::pmr::vector<ut64> GraphGridLayout::topoSort(LayoutState &state, ut64 entry)
 {
     auto &blocks = *state.blocks;
 
     // Run DFS to:
     // * select backwards/loop edges
     // * perform toposort
-    std::vector<ut64> blockOrder;
+    std::pmr::vector<ut64> blockOrder(state.resource);
+    blockOrder.reserve(blocks.size());
     enum class State : uint8_t { NotVisited = 0, InStack, Visited };
-    std::unordered_map<ut64, State> visited;
+    std::pmr::unordered_map<ut64, State> visited(state.resource);
     visited.reserve(state.blocks->size());
-    std::stack<std::pair<ut64, size_t>> stack;
+    using StackItem = std::pair<ut64, size_t>;
+    std::stack<StackItem, std::pmr::deque<StackItem>> stack(
+            std::pmr::deque<StackItem>(state.resource));
     auto dfsFragment = [&visited, &blocks, &state, &stack, &blockOrder](ut64 first) {
         visited[first] = State::InStack;
         stack.push({ first, 0 });
@@ -250,7 +256,7 @@ std::vector<ut64> GraphGridLayout::topoSort(LayoutState &state, ut64 entry)
 }
 
 void GraphGridLayout::assignRows(GraphGridLayout::LayoutState &state,
-                                 const std::vector<unsigned long long> &blockOrder)
+                                 const std::pmr::vector<ut64> &blockOrder)
 {
     for (auto it = blockOrder.rbegin(), end = blockOrder.rend(); it != end; it++) {
         auto &block = state.grid_blocks[*it];
@@ -279,7 +285,10 @@ void GraphGridLayout::selectTree(GraphGridLayout::LayoutState &state)
 void GraphGridLayout::CalculateLayout(GraphLayout::Graph &blocks, ut64 entry, int &width,
                                       int &height) const
 {
-    LayoutState layoutState;
+    // Memory of the previous run is reused, the state of this run is released when it goes out of
+    // scope
+    arena.reset();
+    LayoutState layoutState(&arena);
     layoutState.blocks = &blocks;
     if (blocks.empty()) {
         return;
@@ -289,9 +298,7 @@ void GraphGridLayout::CalculateLayout(GraphLayout::Graph &blocks, ut64 entry, in
     }
 
     for (auto &it : blocks) {
-        GridBlock block;
-        block.id = it.first;
-        layoutState.grid_blocks[it.first] = block;
+        layoutState.grid_blocks[it.first].id = it.first;
     }
 
     auto blockOrder = topoSort(layoutState, entry);
@@ -341,6 +348,11 @@ void GraphGridLayout::CalculateLayout(GraphLayout::Graph &blocks, ut64 entry, in
         optimizeLayout(layoutState);
         cropToContent(blocks, width, height);
     }
+
+    // Once the arena grew to the size of the graphs the upstream bytes stop increasing
+    const auto &stats = arena.getStats();
+    Metrics::instance().layoutArenaAllocations.add(stats.allocations);
+    Metrics::instance().layoutArenaUpstreamBytes.add(stats.upstreamBytes);
 }
 
 void GraphGridLayout::findMergePoints(GraphGridLayout::LayoutState &state) const
@@ -387,7 +399,7 @@ void GraphGridLayout::findMergePoints(GraphGridLayout::LayoutState &state) const
     }
 }
 
-void GraphGridLayout::computeAllBlockPlacement(const std::vector<ut64> &blockOrder,
+void GraphGridLayout::computeAllBlockPlacement(const std::pmr::vector<ut64> &blockOrder,
                                                LayoutState &layoutState) const
 {
     assignRows(layoutState, blockOrder);
@@ -397,7 +409,8 @@ void GraphGridLayout::computeAllBlockPlacement(const std::vector<ut64> &blockOrd
     // Shapes of subtrees are maintained using linked lists. Each value within list is column
     // relative to previous row. This allows moving things around by changing only first value in
     // list.
-    LinkedListPool<int> sides(blockOrder.size() * 2); // *2 = two sides for each node
+    // *2 = two sides for each node
+    LinkedListPool<int> sides(blockOrder.size() * 2, layoutState.resource);
 
     // Process nodes in the order from bottom to top. Ensures that all subtrees are processed before
     // parent node.
@@ -561,18 +574,16 @@ void GraphGridLayout::calculateEdgeMainColumn(GraphGridLayout::LayoutState &stat
         enum Type { Edge = 0, Block = 1 } type;
     };
     // create events
-    std::vector<Event> events;
+    std::pmr::vector<Event> events(state.resource);
     events.reserve(state.grid_blocks.size() * 2);
     for (const auto &it : state.grid_blocks) {
         events.push_back({ it.first, 0, it.second.row, Event::Block });
         const auto &inputBlock = (*state.blocks)[it.first];
         int startRow = it.second.row + 1;
 
-        auto gridEdges = state.edge[it.first];
-        gridEdges.resize(inputBlock.edges.size());
+        // state.edge destinations were already filled by CalculateLayout
         for (size_t i = 0; i < inputBlock.edges.size(); i++) {
             auto targetId = inputBlock.edges[i].target;
-            gridEdges[i].dest = targetId;
             const auto &targetGridBlock = state.grid_blocks[targetId];
             int endRow = targetGridBlock.row;
             events.push_back({ it.first, i, std::max(startRow, endRow), Event::Edge });
@@ -589,10 +600,10 @@ void GraphGridLayout::calculateEdgeMainColumn(GraphGridLayout::LayoutState &stat
     PointSetMinTree blockedColumns(state.columns + 1, -1);
     for (const auto &event : events) {
         if (event.type == Event::Block) {
-            auto block = state.grid_blocks[event.blockId];
+            const auto &block = state.grid_blocks[event.blockId];
             blockedColumns.set(block.col + 1, event.row);
         } else {
-            auto block = state.grid_blocks[event.blockId];
+            const auto &block = state.grid_blocks[event.blockId];
             int column = block.col + 1;
             auto &edge = state.edge[event.blockId][event.edgeId];
             const auto &targetBlock = state.grid_blocks[edge.dest];
@@ -756,11 +767,13 @@ struct NodeSide
  * @param segmentSpacing The expected spacing between two segments in the same column. Actual
  * spacing may be smaller for nodes with many edges.
  */
-void calculateSegmentOffsets(std::vector<EdgeSegment> &segments, std::vector<int> &edgeOffsets,
-                             std::vector<int> &edgeColumnWidth,
-                             std::vector<NodeSide> &nodeRightSide,
-                             std::vector<NodeSide> &nodeLeftSide,
-                             const std::vector<int> &columnWidth, size_t H, int segmentSpacing)
+void calculateSegmentOffsets(std::pmr::vector<EdgeSegment> &segments,
+                             std::pmr::vector<int> &edgeOffsets,
+                             std::pmr::vector<int> &edgeColumnWidth,
+                             std::pmr::vector<NodeSide> &nodeRightSide,
+                             std::pmr::vector<NodeSide> &nodeLeftSide,
+                             const std::pmr::vector<int> &columnWidth, size_t H,
+                             int segmentSpacing)
 {
     for (auto &segment : segments) {
         if (segment.y0 > segment.y1) {
@@ -868,8 +881,9 @@ void calculateSegmentOffsets(std::vector<EdgeSegment> &segments, std::vector<int
  * @param edgeColumnWidth widths of edge columns
  * @param segments either all horizontal or all vertical edge segments
  */
-static void centerEdges(std::vector<int> &segmentOffsets, const std::vector<int> &edgeColumnWidth,
-                        const std::vector<EdgeSegment> &segments)
+static void centerEdges(std::pmr::vector<int> &segmentOffsets,
+                        const std::pmr::vector<int> &edgeColumnWidth,
+                        const std::pmr::vector<EdgeSegment> &segments)
 {
     /* Split segments in each edge column into non intersecting chunks. Center each chunk
      * separately.
@@ -884,7 +898,7 @@ static void centerEdges(std::vector<int> &segmentOffsets, const std::vector<int>
         int index;
         bool start;
     };
-    std::vector<Event> events;
+    std::pmr::vector<Event> events(segments.get_allocator());
     events.reserve(segments.size() * 2);
     for (const auto &segment : segments) {
         auto offset = segmentOffsets[segment.edgeIndex];
@@ -935,10 +949,11 @@ static void centerEdges(std::vector<int> &segmentOffsets, const std::vector<int>
  * @param rightSides
  * @return Size of compressed coordinate range.
  */
-static int compressCoordinates(std::vector<EdgeSegment> &segments, std::vector<NodeSide> &leftSides,
-                               std::vector<NodeSide> &rightSides)
+static int compressCoordinates(std::pmr::vector<EdgeSegment> &segments,
+                               std::pmr::vector<NodeSide> &leftSides,
+                               std::pmr::vector<NodeSide> &rightSides)
 {
-    std::vector<int> positions;
+    std::pmr::vector<int> positions(segments.get_allocator());
     positions.reserve((segments.size() + leftSides.size()) * 2);
     for (const auto &segment : segments) {
         positions.push_back(segment.y0);
@@ -989,10 +1004,10 @@ void GraphGridLayout::elaborateEdgePlacement(GraphGridLayout::LayoutState &state
         return segment;
     };
 
-    std::vector<EdgeSegment> segments;
-    std::vector<NodeSide> rightSides;
-    std::vector<NodeSide> leftSides;
-    std::vector<int> edgeOffsets;
+    std::pmr::vector<EdgeSegment> segments(state.resource);
+    std::pmr::vector<NodeSide> rightSides(state.resource);
+    std::pmr::vector<NodeSide> leftSides(state.resource);
+    std::pmr::vector<int> edgeOffsets(state.resource);
 
     // Vertical segments
     for (auto &edgeListIt : state.edge) {
@@ -1051,7 +1066,7 @@ void GraphGridLayout::elaborateEdgePlacement(GraphGridLayout::LayoutState &state
             }
         }
     };
-    auto oldColumnWidths = state.columnWidth;
+    std::pmr::vector<int> oldColumnWidths(state.columnWidth, state.resource);
     adjustColumnWidths(state);
     for (auto &segment : segments) {
         auto &offset = edgeOffsets[segment.edgeIndex];
@@ -1130,10 +1145,10 @@ void GraphGridLayout::adjustColumnWidths(GraphGridLayout::LayoutState &state) co
     }
 }
 
-int GraphGridLayout::calculateColumnOffsets(const std::vector<int> &columnWidth,
-                                            std::vector<int> &edgeColumnWidth,
-                                            std::vector<int> &columnOffset,
-                                            std::vector<int> &edgeColumnOffset)
+int GraphGridLayout::calculateColumnOffsets(const std::pmr::vector<int> &columnWidth,
+                                            std::pmr::vector<int> &edgeColumnWidth,
+                                            std::pmr::vector<int> &columnOffset,
+                                            std::pmr::vector<int> &edgeColumnOffset)
 {
     assert(edgeColumnWidth.size() == columnWidth.size() + 1);
     int position = 0;
@@ -1263,27 +1278,29 @@ using Constraint = std::pair<std::pair<int, int>, int>;
  * @brief Single pass of linear program optimizer.
  * Changes variables until a constraint is hit, afterwards the two variables are changed together.
  * @param n number of variables
- * @param objectiveFunction coefficients for function \f$\sum c_i x_i\f$ which needs to be minimized
- * @param inequalities inequality constraints \f$x_{e_i} - x_{f_i} \leq b_i\f$
- * @param equalities equality constraints \f$x_{e_i} - x_{f_i} = b_i\f$
+ * @param objectiveFunction coefficients for function \f$\sum c_i x_i\f$ which needs to be
+ * minimized, modified by the pass
+ * @param inequalities inequality constraints \f$x_{e_i} - x_{f_i} \leq b_i\f$, modified by the pass
+ * @param equalities equality constraints \f$x_{e_i} - x_{f_i} = b_i\f$, modified by the pass
  * @param solution input/output argument, returns results, needs to be initialized with a feasible
- * solution
+ * solution. Temporary data is allocated from its memory resource.
  * @param stickWhenNotMoving variable grouping strategy
  */
-static void optimizeLinearProgramPass(size_t n, std::vector<int> objectiveFunction,
-                                      std::vector<Constraint> inequalities,
-                                      std::vector<Constraint> equalities,
-                                      std::vector<int> &solution, bool stickWhenNotMoving)
+static void optimizeLinearProgramPass(size_t n, std::pmr::vector<int> &objectiveFunction,
+                                      std::pmr::vector<Constraint> &inequalities,
+                                      std::pmr::vector<Constraint> &equalities,
+                                      std::pmr::vector<int> &solution, bool stickWhenNotMoving)
 {
-    std::vector<int> group(n);
+    auto resource = solution.get_allocator().resource();
+    std::pmr::vector<int> group(n, resource);
     std::iota(group.begin(), group.end(), 0); // initially each variable is in it's own group
     assert(n == objectiveFunction.size());
     assert(n == solution.size());
-    std::vector<size_t> edgeCount(n);
+    std::pmr::vector<size_t> edgeCount(n, resource);
 
-    LinkedListPool<size_t> edgePool(inequalities.size() * 2);
+    LinkedListPool<size_t> edgePool(inequalities.size() * 2, resource);
 
-    std::vector<decltype(edgePool)::List> edges(n);
+    std::pmr::vector<decltype(edgePool)::List> edges(n, resource);
 
     auto getGroup = [&](int v) {
         while (group[v] != v) {
@@ -1303,10 +1320,10 @@ static void optimizeLinearProgramPass(size_t n, std::vector<int> objectiveFuncti
         edgeCount[a]++;
         edgeCount[b]++;
     }
-    std::vector<uint8_t> processed(n);
+    std::pmr::vector<uint8_t> processed(n, resource);
     // Smallest variable value in the group relative to main one, this is used to maintain implicit
     // x_i >= 0 constraint
-    std::vector<int> groupRelativeMin(n, 0);
+    std::pmr::vector<int> groupRelativeMin(n, 0, resource);
 
     auto joinSegmentGroups = [&](int a, int b) {
         a = getGroup(a);
@@ -1370,9 +1387,10 @@ static void optimizeLinearProgramPass(size_t n, std::vector<int> objectiveFuncti
     // Priority queue for processing groups starting with currently smallest one. Doing it this way
     // should result in number of constraints within group doubling each time two groups are joined.
     // That way each constraint is processed no more than log(n) times.
-    std::priority_queue<std::pair<int, int>, std::vector<std::pair<int, int>>,
+    std::priority_queue<std::pair<int, int>, std::pmr::vector<std::pair<int, int>>,
                         std::greater<std::pair<int, int>>>
-            queue;
+            queue(std::greater<std::pair<int, int>> {},
+                  std::pmr::vector<std::pair<int, int>>(resource));
     for (size_t i = 0; i < n; i++) {
         if (!processed[i]) {
             queue.push({ edgeCount[i], i });
@@ -1457,15 +1475,16 @@ static void optimizeLinearProgramPass(size_t n, std::vector<int> objectiveFuncti
  * Does not guarantee optimal solution.
  * @param n number of variables
  * @param objectiveFunction coefficients for function \f$\sum c_i x_i\f$ which needs to be minimized
- * @param inequalities inequality constraints \f$x_{e_i} - x_{f_i} \leq b_i\f$
+ * @param inequalities inequality constraints \f$x_{e_i} - x_{f_i} \leq b_i\f$, redundant ones are
+ * removed
  * @param equalities equality constraints \f$x_{e_i} - x_{f_i} = b_i\f$
  * @param solution input/output argument, returns results, needs to be initialized with a feasible
  * solution
  */
-static void optimizeLinearProgram(size_t n, const std::vector<int> &objectiveFunction,
-                                  std::vector<Constraint> inequalities,
-                                  const std::vector<Constraint> &equalities,
-                                  std::vector<int> &solution)
+static void optimizeLinearProgram(size_t n, const std::pmr::vector<int> &objectiveFunction,
+                                  std::pmr::vector<Constraint> &inequalities,
+                                  const std::pmr::vector<Constraint> &equalities,
+                                  std::pmr::vector<int> &solution)
 {
     // Remove redundant inequalities
     std::sort(inequalities.begin(), inequalities.end());
@@ -1475,8 +1494,14 @@ static void optimizeLinearProgram(size_t n, const std::vector<int> &objectiveFun
     inequalities.erase(uniqueEnd, inequalities.end());
 
     static const int ITERATIONS = 1;
+    auto resource = solution.get_allocator().resource();
     for (int i = 0; i < ITERATIONS; i++) {
-        optimizeLinearProgramPass(n, objectiveFunction, inequalities, equalities, solution, true);
+        // The pass modifies its arguments, the copies are placed in the scratch arena
+        std::pmr::vector<int> passObjective(objectiveFunction, resource);
+        std::pmr::vector<Constraint> passInequalities(inequalities, resource);
+        std::pmr::vector<Constraint> passEqualities(equalities, resource);
+        optimizeLinearProgramPass(n, passObjective, passInequalities, passEqualities, solution,
+                                  true);
         // optimizeLinearProgramPass(n, objectiveFunction, inequalities, equalities, solution,
         // false);
     }
@@ -1492,7 +1517,7 @@ struct Segment
 }
 
 static Constraint createInequality(size_t a, int posA, size_t b, int posB, int minSpacing,
-                                   const std::vector<int> &positions)
+                                   const std::pmr::vector<int> &positions)
 {
     minSpacing = std::min(minSpacing, posB - posA);
     return { { a, b }, posB - positions[b] - (posA - positions[a]) - minSpacing };
@@ -1502,7 +1527,7 @@ static Constraint createInequality(size_t a, int posA, size_t b, int posB, int m
  * @brief Create inequality constraints from segments which preserves their relative order on single
  * axis.
  *
- * @param segments list of edge segments and block sides
+ * @param segments list of edge segments and block sides, gets sorted
  * @param positions initial element positions before optimization
  * @param blockCount number of variables representing blocks, it is assumed that segments with
  * variableId < \a blockCount represent one side of block.
@@ -1514,15 +1539,15 @@ static Constraint createInequality(size_t a, int posA, size_t b, int posB, int m
  * @param inequalities output variable for resulting inequalities, values initially stored in it are
  * not removed
  */
-static void createInequalitiesFromSegments(std::vector<Segment> segments,
-                                           const std::vector<int> &positions,
-                                           const std::vector<size_t> &variableGroup, int blockCount,
-                                           int blockSpacing, int segmentSpacing,
-                                           std::vector<Constraint> &inequalities)
+static void createInequalitiesFromSegments(std::pmr::vector<Segment> &segments,
+                                           const std::pmr::vector<int> &positions,
+                                           const std::pmr::vector<size_t> &variableGroup,
+                                           int blockCount, int blockSpacing, int segmentSpacing,
+                                           std::pmr::vector<Constraint> &inequalities)
 {
     // map used as binary search tree y_position -> segment{variableId, x_position}
     // It is used to maintain which segment was last seen in the range y_position..
-    std::map<int, std::pair<int, int>> lastSegments;
+    std::pmr::map<int, std::pair<int, int>> lastSegments(segments.get_allocator());
     lastSegments[-1] = { -1, -1 };
 
     std::sort(segments.begin(), segments.end(),
@@ -1571,18 +1596,19 @@ static void createInequalitiesFromSegments(std::vector<Segment> segments,
 
 void GraphGridLayout::optimizeLayout(GraphGridLayout::LayoutState &state) const
 {
-    std::unordered_map<uint64_t, int> blockMapping;
+    std::pmr::unordered_map<uint64_t, int> blockMapping(state.resource);
+    blockMapping.reserve(state.blocks->size());
     size_t blockIndex = 0;
     for (auto &blockIt : *state.blocks) {
         blockMapping[blockIt.first] = blockIndex++;
     }
-    std::vector<size_t> variableGroups(blockMapping.size());
+    std::pmr::vector<size_t> variableGroups(blockMapping.size(), state.resource);
     std::iota(variableGroups.begin(), variableGroups.end(), 0);
 
-    std::vector<int> objectiveFunction;
-    std::vector<Constraint> inequalities;
-    std::vector<Constraint> equalities;
-    std::vector<int> solution;
+    std::pmr::vector<int> objectiveFunction(state.resource);
+    std::pmr::vector<Constraint> inequalities(state.resource);
+    std::pmr::vector<Constraint> equalities(state.resource);
+    std::pmr::vector<int> solution(state.resource);
 
     auto addObjective = [&](size_t a, int posA, size_t b, int posB) {
         objectiveFunction.resize(std::max(objectiveFunction.size(), std::max(a, b) + 1));
@@ -1607,7 +1633,8 @@ void GraphGridLayout::optimizeLayout(GraphGridLayout::LayoutState &state) const
         solution[variable] = value;
     };
 
-    auto copyVariablesToPositions = [&](const std::vector<int> &solution, bool horizontal = false) {
+    auto copyVariablesToPositions = [&](const std::pmr::vector<int> &solution,
+                                        bool horizontal = false) {
 #ifndef NDEBUG
         for (auto v : solution) {
             assert(v >= 0);
@@ -1633,7 +1660,7 @@ void GraphGridLayout::optimizeLayout(GraphGridLayout::LayoutState &state) const
         }
     };
 
-    std::vector<Segment> segments;
+    std::pmr::vector<Segment> segments(state.resource);
     segments.reserve(state.blocks->size() * 2 + state.blocks->size() * 2);
     size_t variableIndex = state.blocks->size();
     size_t edgeIndex = 0;
@@ -1676,7 +1703,7 @@ void GraphGridLayout::optimizeLayout(GraphGridLayout::LayoutState &state) const
         setFeasibleSolution(blockVariable, block.y);
     }
 
-    createInequalitiesFromSegments(std::move(segments), solution, variableGroups,
+    createInequalitiesFromSegments(segments, solution, variableGroups,
                                    blockMapping.size(), layoutConfig.blockVerticalSpacing,
                                    layoutConfig.edgeVerticalSpacing, inequalities);
 
@@ -1729,7 +1756,7 @@ void GraphGridLayout::optimizeLayout(GraphGridLayout::LayoutState &state) const
         setFeasibleSolution(blockVariable, block.x);
     }
 
-    createInequalitiesFromSegments(std::move(segments), solution, variableGroups,
+    createInequalitiesFromSegments(segments, solution, variableGroups,
                                    blockMapping.size(), layoutConfig.blockHorizontalSpacing,
                                    layoutConfig.edgeHorizontalSpacing, inequalities);
 
@@ -4,6 +4,9 @@
 #include "core/Cutter.h"
 #include "GraphLayout.h"
 #include "common/LinkedListPool.h"
+#include "common/ScratchArena.h"
+
+#include <memory_resource>
 
 /**
  * @brief Graph layout algorithm on layered graph layout approach. For simplicity all the nodes are
@@ -34,11 +37,19 @@ private:
     bool verticalBlockAlignmentMiddle = false;
     bool useLayoutOptimization = true;
 
+    /// Scratch memory for the layout state, reused by every CalculateLayout call
+    mutable ScratchArena arena;
+
     struct GridBlock
     {
+        using allocator_type = std::pmr::polymorphic_allocator<>;
+
+        GridBlock() = default;
+        explicit GridBlock(const allocator_type &alloc) : tree_edge(alloc), dag_edge(alloc) {}
+
         ut64 id;
-        std::vector<ut64> tree_edge; //!< subset of outgoing edges that form a tree
-        std::vector<ut64> dag_edge; //!< subset of outgoing edges that form a dag
+        std::pmr::vector<ut64> tree_edge; //!< subset of outgoing edges that form a tree
+        std::pmr::vector<ut64> dag_edge; //!< subset of outgoing edges that form a dag
         std::size_t has_parent = false;
         int inputCount = 0;
         int outputCount = 0;
@@ -71,9 +82,21 @@ private:
 
     struct GridEdge
     {
+        using allocator_type = std::pmr::polymorphic_allocator<>;
+
+        GridEdge() = default;
+        explicit GridEdge(const allocator_type &alloc) : points(alloc) {}
+        GridEdge(GridEdge &&other, const allocator_type &alloc)
+            : dest(other.dest),
+              mainColumn(other.mainColumn),
+              points(std::move(other.points), alloc),
+              secondaryPriority(other.secondaryPriority)
+        {
+        }
+
         ut64 dest;
         int mainColumn = -1;
-        std::vector<Point> points;
+        std::pmr::vector<Point> points;
         int secondaryPriority;
 
         void addPoint(int row, int col, int16_t kind = 0)
@@ -82,25 +105,44 @@ private:
         }
     };
 
+    /**
+     * @brief Temporary state of single layout run, all the containers use the scratch arena.
+     */
     struct LayoutState
     {
-        std::unordered_map<ut64, GridBlock> grid_blocks;
+        explicit LayoutState(std::pmr::memory_resource *resource)
+            : resource(resource),
+              grid_blocks(resource),
+              edge(resource),
+              columnWidth(resource),
+              rowHeight(resource),
+              edgeColumnWidth(resource),
+              edgeRowHeight(resource),
+              columnOffset(resource),
+              rowOffset(resource),
+              edgeColumnOffset(resource),
+              edgeRowOffset(resource)
+        {
+        }
+
+        std::pmr::memory_resource *resource;
+        std::pmr::unordered_map<ut64, GridBlock> grid_blocks;
         std::unordered_map<ut64, GraphBlock> *blocks = nullptr;
-        std::unordered_map<ut64, std::vector<GridEdge>> edge;
+        std::pmr::unordered_map<ut64, std::pmr::vector<GridEdge>> edge;
         size_t rows = -1;
         size_t columns = -1;
-        std::vector<int> columnWidth;
-        std::vector<int> rowHeight;
-        std::vector<int> edgeColumnWidth;
-        std::vector<int> edgeRowHeight;
-
-        std::vector<int> columnOffset;
-        std::vector<int> rowOffset;
-        std::vector<int> edgeColumnOffset;
-        std::vector<int> edgeRowOffset;
+        std::pmr::vector<int> columnWidth;
+        std::pmr::vector<int> rowHeight;
+        std::pmr::vector<int> edgeColumnWidth;
+        std::pmr::vector<int> edgeRowHeight;
+
+        std::pmr::vector<int> columnOffset;
+        std::pmr::vector<int> rowOffset;
+        std::pmr::vector<int> edgeColumnOffset;
+        std::pmr::vector<int> edgeRowOffset;
     };
 
-    using GridBlockMap = std::unordered_map<ut64, GridBlock>;
+    using GridBlockMap = std::pmr::unordered_map<ut64, GridBlock>;
 
     /**
      * @brief Find nodes where control flow merges after splitting.
@@ -112,7 +154,7 @@ private:
      * @brief Compute node rows and columns within grid.
      * @param blockOrder Nodes in the reverse topological order.
      */
-    void computeAllBlockPlacement(const std::vector<ut64> &blockOrder,
+    void computeAllBlockPlacement(const std::pmr::vector<ut64> &blockOrder,
                                   LayoutState &layoutState) const;
     /**
      * @brief Perform the topological sorting of graph nodes.
@@ -122,14 +164,14 @@ private:
      * @param entry Entrypoint node. When removing loops prefer placing this node at top.
      * @return Reverse topological ordering.
      */
-    static std::vector<ut64> topoSort(LayoutState &state, ut64 entry);
+    static std::pmr::vector<ut64> topoSort(LayoutState &state, ut64 entry);
 
     /**
      * @brief Assign row positions to nodes.
      * @param state
      * @param blockOrder reverse topological ordering of nodes
      */
-    static void assignRows(LayoutState &state, const std::vector<ut64> &blockOrder);
+    static void assignRows(LayoutState &state, const std::pmr::vector<ut64> &blockOrder);
     /**
      * @brief Select subset of DAG edges that form tree.
      * @param state
@@ -165,10 +207,10 @@ private:
      * @param edgeColumnOffset
      * @return total width of all the columns
      */
-    static int calculateColumnOffsets(const std::vector<int> &columnWidth,
-                                      std::vector<int> &edgeColumnWidth,
-                                      std::vector<int> &columnOffset,
-                                      std::vector<int> &edgeColumnOffset);
+    static int calculateColumnOffsets(const std::pmr::vector<int> &columnWidth,
+                                      std::pmr::vector<int> &edgeColumnWidth,
+                                      std::pmr::vector<int> &columnOffset,
+                                      std::pmr::vector<int> &edgeColumnOffset);
     /**
      * @brief Final graph layout step. Convert grids cell relative positions to absolute pixel
      * positions.
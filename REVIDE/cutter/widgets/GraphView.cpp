@@ -137,10 +137,11 @@ void GraphView::computeGraphPlacement()
 
 void GraphView::cleanupEdges(GraphLayout::Graph &graph)
 {
+    std::unordered_set<ut64> seenEdges;
     for (auto &blockIt : graph) {
         auto &block = blockIt.second;
         auto outIt = block.edges.begin();
-        std::unordered_set<ut64> seenEdges;
+        seenEdges.clear();
         for (auto it = block.edges.begin(), end = block.edges.end(); it != end; ++it) {
             // remove edges going  to different functions
             // and remove duplicate edges, common in switch statements
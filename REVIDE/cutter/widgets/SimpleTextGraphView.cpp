@@ -120,8 +120,8 @@ void SimpleTextGraphView::drawBlock(QPainter &p, GraphView::GraphBlock &block, b
     p.setPen(palette().color(QPalette::WindowText));
     // Render node text
     auto x = block.x + padding / 2;
-    int y = block.y + padding / 2 + p.fontMetrics().ascent();
-    p.drawText(QPoint(x, y), content.text);
+    int y = block.y + padding / 2;
+    p.drawStaticText(QPointF(x, y), content.staticText);
 }
 
 GraphView::EdgeConfiguration SimpleTextGraphView::edgeConfiguration(GraphView::GraphBlock &from,
@@ -151,6 +151,9 @@ void SimpleTextGraphView::addBlock(GraphLayout::GraphBlock block, const QString
     auto &content = blockContent[block.entry];
     content.text = text;
     content.address = address;
+    content.staticText.setText(text);
+    content.staticText.setTextFormat(Qt::PlainText);
+    content.staticText.setPerformanceHint(QStaticText::AggressiveCaching);
 
     int height = 1;
     int width = mFontMetrics->width(text);
@@ -7,6 +7,7 @@
 #include <QPainter>
 #include <QShortcut>
 #include <QLabel>
+#include <QStaticText>
 
 #include "widgets/CutterGraphView.h"
 #include "menus/AddressableItemContextMenu.h"
@@ -69,6 +70,11 @@ protected:
     {
         QString text;
         RVA address;
+        /**
+         * Text shaped once and reused by drawBlock. Qt lays it out again only when the font or the
+         * scale of the painter changes.
+         */
+        QStaticText staticText;
     };
     std::unordered_map<ut64, BlockContent> blockContent;
 
@@ -35,6 +35,12 @@ int main(int argc, char* argv[])
     int port = 13337;
     QCommandLineOption paramPort("port", QCoreApplication::translate("main", "Port to listen on (defaults to %1)").arg(port), "port");
     parser.addOption(paramPort);
+    QCommandLineOption paramJournal("journal", QCoreApplication::translate("main", "Append the received dumps to a journal file"), "file");
+    parser.addOption(paramJournal);
+    QCommandLineOption paramReplay("replay", QCoreApplication::translate("main", "Feed the dumps of a journal file into REVIDE and log the throughput"), "file");
+    parser.addOption(paramReplay);
+    QCommandLineOption paramReplaySpeed("replay-speed", QCoreApplication::translate("main", "Replay the dumps at their original pace (original) or as fast as possible (max, default)"), "speed", "max");
+    parser.addOption(paramReplaySpeed);
     parser.addPositionalArgument("files", QCoreApplication::translate("main", "File(s) to open, optionally"), "[files...]");
     parser.process(app);
 
@@ -83,11 +89,16 @@ int main(int argc, char* argv[])
     // Create main window
     MainWindow w(port);
 
-    // Load the files specified on the command line
+    // Load the files specified on the command line (parsed in parallel, opened in order)
     // TODO: use http requests when another instance is already open
     for (const auto& file : parser.positionalArguments())
         w.loadFile(QFileInfo(file));
 
+    if (parser.isSet(paramJournal))
+        w.startJournal(parser.value(paramJournal));
+    if (parser.isSet(paramReplay))
+        w.replayJournal(parser.value(paramReplay), parser.value(paramReplaySpeed) == "original");
+
     // Handle the --noserver command line
     if (parser.isSet(paramNoServer))
         w.noServer();
@@ -0,0 +1,42 @@
+// Every textual module of a batch has to parse, not only the last one
+#include "IngestBatch.h"
+#include "ParseModule.h"
+
+#include <cstdio>
+
+int main()
+{
+    const char* modules[] = {
+        "define i32 @first() {\n  ret i32 1\n}\n",
+        "@second = global i32 2\n",
+        "define i32 @third() {\n  ret i32 3\n}\n",
+    };
+
+    QByteArray batch = "REVIDE-BATCH\n";
+    for (int i = 0; i < 3; i++)
+    {
+        QByteArray payload(modules[i]);
+        batch += QString("%1 {\"type\":\"module\",\"title\":\"module%2\"}\n").arg(payload.size()).arg(i).toUtf8();
+        batch += payload;
+    }
+
+    std::vector<BatchEntry> entries;
+    if (!parseBatch(batch, "127.0.0.1", entries) || entries.size() != 3)
+    {
+        puts("malformed batch");
+        return 1;
+    }
+
+    auto result = 0;
+    for (auto& entry : entries)
+    {
+        copyPayload(entry);
+        std::string errorMessage;
+        if (!parseModule(entry.data, errorMessage))
+        {
+            printf("%s: %s\n", entry.title.toUtf8().constData(), errorMessage.c_str());
+            result = 1;
+        }
+    }
+    return result;
+}
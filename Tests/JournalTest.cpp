@@ -0,0 +1,50 @@
+// Every textual module of a journal has to parse when it is replayed, not only the last one
+#include "IngestJournal.h"
+#include "ParseModule.h"
+
+#include <QTemporaryDir>
+
+#include <cstdio>
+
+int main()
+{
+    QTemporaryDir dir;
+    auto path = dir.filePath("journal.bin");
+    QString errorMessage;
+    {
+        IngestJournal journal;
+        if (!journal.open(path, errorMessage))
+        {
+            printf("%s\n", errorMessage.toUtf8().constData());
+            return 1;
+        }
+        journal.append("module", "first", "define i32 @first() {\n  ret i32 1\n}\n");
+        journal.append("module", "second", "@second = global i32 2\n");
+        journal.append("module", "third", "define i32 @third() {\n  ret i32 3\n}\n");
+    }
+
+    JournalReplay replay;
+    if (!replay.open(path, errorMessage) || replay.size() != 3)
+    {
+        printf("%s\n", errorMessage.toUtf8().constData());
+        return 1;
+    }
+
+    auto result = 0, replayed = 0;
+    QObject::connect(&replay, &JournalReplay::dump, [&](QString type, QString title, QByteArray data, std::shared_ptr<void>) {
+        std::string parseError;
+        if (!parseModule(data, parseError))
+        {
+            printf("%s: %s\n", title.toUtf8().constData(), parseError.c_str());
+            result = 1;
+        }
+        replayed++;
+    });
+    replay.start(false);
+    if (replayed != 3)
+    {
+        printf("%d of 3 records replayed\n", replayed);
+        return 1;
+    }
+    return result;
+}
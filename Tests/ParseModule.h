@@ -0,0 +1,23 @@
+#pragma once
+
+#include <string>
+
+#include <QByteArray>
+
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IRReader/IRReader.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/SourceMgr.h>
+
+// Parses textual IR the way LLVMGlobalContext::Parse does, without copying the data
+inline bool parseModule(const QByteArray& data, std::string& errorMessage)
+{
+    llvm::LLVMContext context;
+    auto buf = llvm::MemoryBuffer::getMemBuffer(llvm::StringRef(data.constData(), data.size()), "", false);
+    llvm::SMDiagnostic err;
+    if (llvm::parseIR(*buf, err, context))
+        return true;
+    errorMessage = "line " + std::to_string(err.getLineNo()) + ": " + err.getMessage().str();
+    return false;
+}
@@ -0,0 +1,131 @@
+// REVIDE::PrintModule has to print exactly what Module::print prints
+#include <ModulePrinter.h>
+
+#include <llvm/IR/AssemblyAnnotationWriter.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IRReader/IRReader.h>
+#include <llvm/Support/FormattedStream.h>
+#include <llvm/Support/SourceMgr.h>
+
+#include <cstdio>
+#include <string>
+
+static const char* header = R"(
+%struct.pair = type { i32, i64 }
+
+@counter = global i32 0, align 4
+@name = private unnamed_addr constant [6 x i8] c"REVIDE", align 1
+
+declare i32 @external(i8*)
+
+)";
+
+static const char* function = R"(
+define i32 @function%1(i32 %n, %struct.pair* %p) #0 {
+entry:
+  %cmp = icmp sgt i32 %n, 0
+  br i1 %cmp, label %loop, label %exit, !prof !0
+
+loop:
+  %i = phi i32 [ 0, %entry ], [ %next, %loop ]
+  %field = getelementptr inbounds %struct.pair, %struct.pair* %p, i32 0, i32 0
+  store volatile i32 %i, i32* %field, align 4
+  %next = add nsw i32 %i, 1
+  %done = icmp eq i32 %next, %n
+  br i1 %done, label %exit, label %loop
+
+exit:
+  %result = phi i32 [ 0, %entry ], [ %next, %loop ]
+  %call = call i32 @external(i8* getelementptr inbounds ([6 x i8], [6 x i8]* @name, i32 0, i32 0))
+  ret i32 %result
+}
+)";
+
+static const char* footer = R"(
+attributes #0 = { noinline nounwind }
+
+!0 = !{!"branch_weights", i32 1, i32 100}
+)";
+
+// Comments at the places the annotation writer of REVIDE uses
+class CommentWriter : public llvm::AssemblyAnnotationWriter
+{
+public:
+    void emitFunctionAnnot(const llvm::Function* F, llvm::formatted_raw_ostream& os) override
+    {
+        os << "; function " << F->getName() << "\n";
+    }
+
+    void emitBasicBlockStartAnnot(const llvm::BasicBlock* BB, llvm::formatted_raw_ostream& os) override
+    {
+        os << "; block\n";
+    }
+
+    void printInfoComment(const llvm::Value& V, llvm::formatted_raw_ostream& os) override
+    {
+        os.PadToColumn(60);
+        os << "; value";
+    }
+};
+
+static bool compare(const llvm::Module& module, llvm::AssemblyAnnotationWriter* writer, bool preserveUseListOrder, bool isForDebug)
+{
+    std::string expected;
+    {
+        llvm::raw_string_ostream os(expected);
+        module.print(os, writer, preserveUseListOrder, isForDebug);
+    }
+    auto actual = REVIDE::PrintModule(module, writer, preserveUseListOrder, isForDebug);
+    if (actual == expected)
+        return true;
+    size_t offset = 0;
+    while (offset < actual.size() && offset < expected.size() && actual[offset] == expected[offset])
+        offset++;
+    printf("%s: output differs at offset %zu (%zu bytes, expected %zu)\n", module.getModuleIdentifier().c_str(), offset, actual.size(), expected.size());
+    return false;
+}
+
+static bool check(const llvm::Module& module)
+{
+    CommentWriter writer;
+    return compare(module, nullptr, false, false) && compare(module, nullptr, true, true) && compare(module, &writer, true, true);
+}
+
+int main(int argc, char** argv)
+{
+    // Enough functions for the output to be many times the size of the stream buffer
+    std::string text = header;
+    for (int i = 0; i < 1000; i++)
+    {
+        std::string body = function;
+        body.replace(body.find("%1"), 2, std::to_string(i));
+        text += body;
+    }
+    text += footer;
+
+    llvm::LLVMContext context;
+    llvm::SMDiagnostic err;
+    auto module = llvm::parseIR(llvm::MemoryBufferRef(text, "generated"), err, context);
+    if (!module)
+    {
+        printf("generated: %s\n", err.getMessage().str().c_str());
+        return 1;
+    }
+    auto result = check(*module) ? 0 : 1;
+
+    // Additional modules (textual or bitcode) from the command line
+    for (int i = 1; i < argc; i++)
+    {
+        auto fileModule = llvm::parseIRFile(argv[i], err, context);
+        if (!fileModule)
+        {
+            printf("%s: %s\n", argv[i], err.getMessage().str().c_str());
+            result = 1;
+        }
+        else if (!check(*fileModule))
+        {
+            result = 1;
+        }
+    }
+    return result;
+}